@@ -0,0 +1,130 @@
+#ifndef IMAGE_ANALYSIS_BATCH_HPP
+#define IMAGE_ANALYSIS_BATCH_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "image_analyzer.hpp"
+#include "pipeline.hpp"
+
+
+namespace batch {
+
+    struct Options {
+        /* Images processed concurrently, zero uses all threads of the analyzer's pool */
+        size_t threads = 0;
+        /* Results are written in the order of the images, otherwise as soon as an image is done */
+        bool ordered = true;
+        /* Runs the stages of recognition on dedicated threads instead of whole images per thread */
+        bool pipelined = false;
+        /* Capacity of the queues between pipeline stages */
+        size_t queueCapacity = 4;
+        /* Recognizes every image in square tiles of this size, zero processes whole images */
+        uint32_t tileSize = 0;
+        /* Labels only regions of cells of this size holding foreground, zero labels whole images */
+        uint32_t coarseFactor = 0;
+        int flags = 0;
+    };
+
+    /* Expands directories into the images they contain sorted by name, other paths are kept as given */
+    std::vector<std::string> collectImages(const std::vector<std::string> & paths);
+
+    /* A single line per image - path, number of objects and id:type:left,top,right,bottom of every object */
+    std::string formatResult(const std::string & path, const std::vector<Object> & objects);
+    std::string formatError(const std::string & path, const std::string & message);
+
+    /* Serializes the result lines of concurrently processed images. In ordered mode a line */
+    /* is held back until the lines of all preceding images have been written.             */
+    class ResultWriter {
+
+        std::ostream & out;
+        const bool ordered;
+
+        std::mutex mtx;
+        size_t next = 0;
+        std::map<size_t, std::string> pending;
+
+    public:
+
+        ResultWriter(std::ostream & out, bool ordered);
+
+        void write(size_t idx, std::string line);
+    };
+
+    /* Recognizes every image on the thread pool of the analyzer, each task owning a copy */
+    /* of the trained analyzer. Returns the number of images which could not be processed. */
+    template <typename Analyzer>
+    size_t process(const Analyzer & trained, const std::vector<std::string> & images, const Options & options, std::ostream & out);
+
+    /* Recognizes the images in order using the stage-pipelined engine */
+    template <typename Analyzer>
+    size_t processPipelined(const Analyzer & trained, const std::vector<std::string> & images, const Options & options, std::ostream & out);
+}
+
+
+template <typename Analyzer>
+size_t batch::process(const Analyzer & trained, const std::vector<std::string> & images, const Options & options, std::ostream & out) {
+
+    if (options.pipelined) {
+        return processPipelined(trained, images, options, out);
+    }
+
+    // Images are tasks on the pool of the analyzer, the stages of each image split further on the same pool
+    auto & pool = trained.threadPool();
+    const size_t slots = std::min(options.threads ? options.threads : pool.size(), images.size());
+
+    ResultWriter writer(out, options.ordered);
+    std::atomic<size_t> next { 0 };
+    std::atomic<size_t> failed { 0 };
+
+    pool.run(slots, [&](const size_t) {
+        Analyzer analyzer(trained);
+
+        for (size_t idx = next++; idx < images.size(); idx = next++) {
+            try {
+                const auto objects = options.tileSize
+                    ? analyzer.recognizeTiled(images[idx], { options.tileSize, options.tileSize }, options.flags)
+                    : options.coarseFactor
+                    ? analyzer.recognizeCoarseToFine(images[idx], options.coarseFactor, options.flags)
+                    : analyzer.recognize(images[idx], options.flags);
+
+                writer.write(idx, formatResult(images[idx], objects));
+            } catch (const std::exception & e) {
+                ++failed;
+                writer.write(idx, formatError(images[idx], e.what()));
+            }
+        }
+    });
+
+    return failed;
+}
+
+template <typename Analyzer>
+size_t batch::processPipelined(const Analyzer & trained, const std::vector<std::string> & images, const Options & options, std::ostream & out) {
+
+    size_t failed = 0;
+
+    Pipeline<Analyzer>(trained, options.flags, options.queueCapacity).run(
+        pipeline::files(images),
+        [&](pipeline::Frame & frame) {
+            const auto & path = images[frame.sequence];
+
+            if (frame.error.empty()) {
+                out << formatResult(path, frame.objects) << std::endl;
+            } else {
+                ++failed;
+                out << formatError(path, frame.error) << std::endl;
+            }
+        }
+    );
+
+    return failed;
+}
+
+
+#endif
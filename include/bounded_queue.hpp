@@ -0,0 +1,113 @@
+#ifndef IMAGE_ANALYSIS_BOUNDED_QUEUE_HPP
+#define IMAGE_ANALYSIS_BOUNDED_QUEUE_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+
+/* Ring buffer connecting a producer thread with a consumer thread. push blocks  */
+/* while the queue is full, which slows the producer down to the pace of the     */
+/* consumer, and pop blocks while the queue is empty. Waiting threads sleep on a */
+/* condition variable, so an idle stage costs no CPU time.                       */
+template <typename T>
+class BoundedQueue {
+
+    std::vector<T> slots;
+
+    /* Indices grow monotonically, the slot of an index is index % capacity */
+    size_t head = 0;
+    size_t tail = 0;
+
+    std::mutex mtx;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+
+public:
+
+    explicit BoundedQueue(size_t capacity);
+
+    BoundedQueue(const BoundedQueue &) = delete;
+    BoundedQueue & operator=(const BoundedQueue &) = delete;
+
+    size_t capacity() const;
+
+    bool tryPush(T & value);
+    bool tryPop(T & value);
+
+    void push(T value);
+    T pop();
+};
+
+
+template <typename T>
+BoundedQueue<T>::BoundedQueue(const size_t capacity) : slots(capacity ? capacity : 1) { }
+
+template <typename T>
+size_t BoundedQueue<T>::capacity() const {
+    return slots.size();
+}
+
+template <typename T>
+bool BoundedQueue<T>::tryPush(T & value) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+
+        if (tail - head == slots.size()) {
+            return false;
+        }
+
+        slots[tail++ % slots.size()] = std::move(value);
+    }
+
+    notEmpty.notify_one();
+    return true;
+}
+
+template <typename T>
+bool BoundedQueue<T>::tryPop(T & value) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+
+        if (head == tail) {
+            return false;
+        }
+
+        value = std::move(slots[head++ % slots.size()]);
+    }
+
+    notFull.notify_one();
+    return true;
+}
+
+template <typename T>
+void BoundedQueue<T>::push(T value) {
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        notFull.wait(lock, [this]() { return tail - head != slots.size(); });
+
+        slots[tail++ % slots.size()] = std::move(value);
+    }
+
+    notEmpty.notify_one();
+}
+
+template <typename T>
+T BoundedQueue<T>::pop() {
+    T value;
+
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        notEmpty.wait(lock, [this]() { return head != tail; });
+
+        value = std::move(slots[head++ % slots.size()]);
+    }
+
+    notFull.notify_one();
+    return value;
+}
+
+
+#endif
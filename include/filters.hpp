@@ -2,7 +2,9 @@
 #define IMAGE_ANALYSIS_FILTERS_HPP
 
 #include "image.hpp"
+#include "thread_pool.hpp"
 
 Image filterBySize(const Image & input, const int threshold);
+Image filterBySize(const Image & input, const int threshold, ThreadPool & pool);
 
 #endif
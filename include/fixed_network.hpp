@@ -0,0 +1,176 @@
+#ifndef IMAGE_ANALYSIS_FIXED_NETWORK_HPP
+#define IMAGE_ANALYSIS_FIXED_NETWORK_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "neural_network.hpp"
+
+
+namespace fixed {
+
+    template <size_t... sizes>
+    struct Topology {
+
+        static constexpr size_t layers = sizeof...(sizes);
+        static constexpr std::array<size_t, layers> size { sizes... };
+
+        static_assert(layers >= 2, "Network must have at least an input and an output layer");
+
+        /* Index of the first weight of a layer in the flattened weights */
+        static constexpr size_t offset(const size_t layer) {
+            size_t total = 0;
+            for (size_t i = 1; i < layer; ++i) {
+                total += size[i-1] * size[i];
+            }
+            return total;
+        }
+
+        static constexpr size_t widest() {
+            size_t max = 0;
+            for (size_t i = 0; i < layers; ++i) {
+                max = size[i] > max ? size[i] : max;
+            }
+            return max;
+        }
+
+        static constexpr size_t weights = offset(layers);
+        static constexpr size_t inputs = size[0];
+        static constexpr size_t outputs = size[layers - 1];
+    };
+
+}
+
+
+/* Inference only counterpart of BackpropagationNetwork with the activation and */
+/* layer sizes known at compile time. All loop bounds are constants and the     */
+/* weights live in a std::array, which lets the compiler unroll and vectorize   */
+/* the whole forward pass. Weights are obtained from a trained runtime network  */
+/* and converted to Scalar, so a network trained in double can run in float.    */
+template <typename Activation, typename Scalar, size_t... sizes>
+class FixedNetwork {
+
+    using Topology = fixed::Topology<sizes...>;
+
+    std::array<Scalar, Topology::weights> weights { };
+
+    template <size_t layer>
+    void forwardLayer(const Scalar * in, Scalar * out) const;
+
+    template <size_t... layer>
+    void forward(const Scalar * input, Scalar * output, std::index_sequence<layer...>) const;
+
+public:
+
+    static constexpr size_t inputs = Topology::inputs;
+    static constexpr size_t outputs = Topology::outputs;
+
+    FixedNetwork() = default;
+
+    template <typename Other>
+    explicit FixedNetwork(const BasicBackpropagationNetwork<Other> & trained);
+
+    std::array<Scalar, outputs> outputValues(const std::array<Scalar, inputs> & input) const;
+    size_t predict(const std::array<Scalar, inputs> & input) const;
+
+    /* Same contract as BackpropagationNetwork::predictBatch */
+    void predictBatch(const Scalar * samples, size_t count, size_t * classes) const;
+};
+
+
+template <typename Activation, typename Scalar, size_t... sizes>
+template <typename Other>
+FixedNetwork<Activation, Scalar, sizes...>::FixedNetwork(const BasicBackpropagationNetwork<Other> & trained) {
+
+    const std::vector<size_t> expected { sizes... };
+
+    if (trained.topology() != expected or trained.weightCount() != Topology::weights) {
+        throw std::runtime_error("Network topology does not match the fixed network");
+    }
+    if (trained.activationFunction() != Activation::kind) {
+        throw std::runtime_error("Network activation does not match the fixed network");
+    }
+
+    std::vector<Other> exported(Topology::weights);
+    trained.exportWeights(exported.data());
+    std::copy(exported.begin(), exported.end(), weights.begin());
+}
+
+template <typename Activation, typename Scalar, size_t... sizes>
+template <size_t layer>
+void FixedNetwork<Activation, Scalar, sizes...>::forwardLayer(const Scalar * in, Scalar * out) const {
+
+    constexpr size_t cols = Topology::size[layer-1];
+    constexpr size_t rows = Topology::size[layer];
+    constexpr size_t offset = Topology::offset(layer);
+
+    for (size_t r = 0; r < rows; ++r) {
+        Scalar sum = 0.0;
+
+        for (size_t c = 0; c < cols; ++c) {
+            sum += weights[offset + r * cols + c] * in[c];
+        }
+
+        out[r] = Activation::apply(sum);
+    }
+}
+
+template <typename Activation, typename Scalar, size_t... sizes>
+template <size_t... layer>
+void FixedNetwork<Activation, Scalar, sizes...>::forward(const Scalar * input, Scalar * output, std::index_sequence<layer...>) const {
+
+    std::array<Scalar, Topology::widest()> a { };
+    std::array<Scalar, Topology::widest()> b { };
+
+    std::copy(input, input + inputs, a.begin());
+
+    Scalar * in = a.data();
+    Scalar * out = b.data();
+
+    // The index sequence starts at zero, the input layer has no weights
+    ((forwardLayer<layer + 1>(in, out), std::swap(in, out)), ...);
+
+    std::copy(in, in + outputs, output);
+}
+
+template <typename Activation, typename Scalar, size_t... sizes>
+std::array<Scalar, FixedNetwork<Activation, Scalar, sizes...>::outputs> FixedNetwork<Activation, Scalar, sizes...>::outputValues(const std::array<Scalar, inputs> & input) const {
+    std::array<Scalar, outputs> out;
+    forward(input.data(), out.data(), std::make_index_sequence<Topology::layers - 1>());
+    return out;
+}
+
+template <typename Activation, typename Scalar, size_t... sizes>
+size_t FixedNetwork<Activation, Scalar, sizes...>::predict(const std::array<Scalar, inputs> & input) const {
+
+    const auto out = outputValues(input);
+
+    // Outputs of tanh networks may all be negative
+    Scalar maxVal = out[0];
+    size_t maxIdx = 0;
+
+    for (size_t i = 1; i != outputs; ++i) {
+        if (out[i] > maxVal) {
+            maxVal = out[i];
+            maxIdx = i;
+        }
+    }
+
+    return maxIdx;
+}
+
+template <typename Activation, typename Scalar, size_t... sizes>
+void FixedNetwork<Activation, Scalar, sizes...>::predictBatch(const Scalar * samples, const size_t count, size_t * classes) const {
+    std::array<Scalar, inputs> input { };
+
+    for (size_t i = 0; i < count; ++i) {
+        std::copy(samples + i * inputs, samples + (i + 1) * inputs, input.begin());
+        classes[i] = predict(input);
+    }
+}
+
+#endif
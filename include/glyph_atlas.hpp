@@ -0,0 +1,65 @@
+#ifndef IMAGE_ANALYSIS_GLYPH_ATLAS_HPP
+#define IMAGE_ANALYSIS_GLYPH_ATLAS_HPP
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <SFML/Graphics/Color.hpp>
+
+
+/* Outlined glyphs rasterized once on the CPU, used to draw text into RGBA buffers */
+/* without a graphics context. Every glyph occupies a cell of the atlas holding   */
+/* the coverage of its fill and of its outline.                                   */
+class GlyphAtlas {
+
+    struct Glyph {
+        bool present = false;
+        /* Position of the cell within the atlas */
+        uint32_t x = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        /* Offset of the cell from the pen position on the baseline */
+        int32_t left = 0;
+        int32_t top = 0;
+        int32_t advance = 0;
+    };
+
+    std::array<Glyph, 128> glyphs;
+
+    uint32_t atlasWidth = 0;
+    uint32_t atlasHeight = 0;
+    std::vector<uint8_t> fillCoverage;
+    std::vector<uint8_t> outlineCoverage;
+
+    struct Bounds {
+        int32_t left;
+        int32_t top;
+        int32_t right;
+        int32_t bottom;
+    };
+
+    /* Ink bounds of text relative to the pen position of its first character */
+    Bounds measure(const std::string & text) const;
+
+public:
+
+    /* Rasterizes the given characters of the font at a pixel size with an outline of the given thickness */
+    GlyphAtlas(const std::string & fontFile, uint32_t size, uint32_t outline, const std::string & characters = "0123456789-");
+
+    /* Draws text centered on (x, y) into the RGBA pixels, only rows firstRow .. lastRow-1 */
+    /* are written, which allows bands of rows to be drawn in parallel. Characters       */
+    /* missing from the atlas are skipped.                                              */
+    void draw(
+        uint8_t * pixels, uint32_t width, uint32_t height,
+        const std::string & text, float x, float y,
+        sf::Color fill, sf::Color outline,
+        uint32_t firstRow, uint32_t lastRow
+    ) const;
+
+    void draw(uint8_t * pixels, uint32_t width, uint32_t height, const std::string & text, float x, float y, sf::Color fill, sf::Color outline) const;
+};
+
+
+#endif
@@ -2,10 +2,12 @@
 #define IMAGE_ANALYSIS_IMAGE_HPP
 
 #include <vector>
+#include <cstdint>
 
 #include <SFML/Graphics.hpp>
 
 #include "pixel.hpp"
+#include "thread_pool.hpp"
 
 
 class Image {
@@ -32,6 +34,16 @@ public:
     Pixel & at(uint32_t x, uint32_t y);
 
     sf::Image reconstruct(const std::vector<sf::Color> & colors) const;
+    sf::Image reconstruct(const std::vector<sf::Color> & colors, ThreadPool & pool) const;
+
+    /* Lookup table of packed RGBA pixels used by reconstruction. Entry i + 1 holds the */
+    /* color of index i, entry 0 the black background, so that the unassigned index    */
+    /* wraps around onto the background.                                                */
+    std::vector<std::uint32_t> palette(const std::vector<sf::Color> & colors, ThreadPool & pool) const;
+
+    /* Writes rows begin .. end-1 of the reconstructed image into a width x height RGBA buffer */
+    void reconstructRows(const std::vector<std::uint32_t> & palette, std::uint8_t * rgba, uint32_t begin, uint32_t end) const;
+    void reconstruct(const std::vector<sf::Color> & colors, std::uint8_t * rgba, ThreadPool & pool) const;
 
 };
 
@@ -1,51 +1,80 @@
 #ifndef IMAGE_ANALYSIS_IMAGE_ANALYZER_HPP
 #define IMAGE_ANALYSIS_IMAGE_ANALYZER_HPP
 
+#include <algorithm>
 #include <vector>
+#include <memory>
+#include <optional>
+#include <random>
 #include <stdexcept>
 #include <iostream>
+#include <typeinfo>
 
 #include <SFML/Graphics.hpp>
 
+#include "object.hpp"
 #include "indexer.hpp"
 #include "signals.hpp"
 #include "recognition.hpp"
 #include "kmeans.hpp"
 #include "thresholder.hpp"
 #include "filters.hpp"
+#include "model.hpp"
+#include "fixed_network.hpp"
+#include "quantization.hpp"
+#include "normalization.hpp"
+#include "thread_pool.hpp"
+#include "glyph_atlas.hpp"
+#include "image_writer.hpp"
+#include "image_view.hpp"
+#include "tiling.hpp"
+#include "pyramid.hpp"
+#include "roi.hpp"
+#include "result_cache.hpp"
 
 
-struct Point {
-    uint32_t x;
-    uint32_t y;
-};
-
-struct Bounds {
-    Point leftTop;
-    Point rightBottom;
-};
-
-struct Object {
-    static constexpr std::uint32_t noType = -1;
-
-    uint32_t id;
-    Bounds bounds;
-    std::uint32_t type = noType;
-};
-
 std::vector<Object> extractObjects(const Image & img);
 
 template <std::uint32_t objects, typename ThresholdProvider>
 class ImageAnalyzer {
 
-    static constexpr int minObjectSize = 15;
-
     Thresholder<ThresholdProvider> tc;
     Indexer idx;
     Recognizer<objects> recognizer;
-    sf::Font font;
 
-    BackpropagationNetwork nn { activ::createSigmoid(1.0), 2, 3, 1, 4 };
+    /* Digits drawn by annotateObjects, rasterized once and shared by copies of the analyzer */
+    std::shared_ptr<const GlyphAtlas> glyphs;
+
+    /* Runs every parallel part of learning and recognition, copies of the analyzer share it. */
+    /* Without one, the pool started on first use by ThreadPool::shared runs them.           */
+    std::shared_ptr<ThreadPool> pool;
+
+    /* Encodes and saves reconstructed and annotated images in the background, shared by copies, */
+    /* its thread is started by the first image                                                 */
+    std::shared_ptr<ImageWriter> writer = std::make_shared<ImageWriter>();
+    output::Formats outputFormats;
+
+    /* Results of recognize by content of the input, shared by copies, none if null */
+    std::shared_ptr<ResultCache> cache;
+
+    static constexpr size_t hiddenNeurons = 4;
+
+    /* Fitted on the training signals, applied to signals before they reach the network */
+    Normalizer normalizer { normalization::Method::standard };
+
+    /* The runtime sized network is trained, inference uses its fixed size copy */
+    BackpropagationNetwork nn { activ::Sigmoid(), 2, objects, 1, hiddenNeurons };
+    FixedNetwork<activ::Sigmoid, float, 2, hiddenNeurons, objects> classifier;
+    /* Calibrated on the training signals, used when recognizing with Flags::quantized */
+    std::optional<QuantizedNetwork> quantized;
+    training::Options trainingOptions;
+    /* More than one candidate trains networks from several seeds and keeps the best */
+    training::SelectionOptions selectionOptions;
+    training::UpdateOptions updateOptions;
+
+    /* Reused between frames by recognizeObjects */
+    std::vector<float> features;
+    std::vector<size_t> classes;
 
 
     std::vector<sf::Color> colors {
@@ -65,68 +94,282 @@ class ImageAnalyzer {
         sf::Color(252, 3, 119)
     };
 
-    std::vector<signals::ObjectSignals> calcSignals(const Image & img, const int flags);
+    /* Decoded files are thresholded from a memory mapping instead of being read row by row */
+    bool mappedInput = false;
 
     void annotateObjects(const Image & img, const std::vector<Object> & obj, const int flags, const std::string filename);
-
-    void reconstructIfDesired(const Image & img, const int flags, const std::string filename);
-    void annotateObjectsIfDesired(const Image & img, const std::vector<Object> & obj, const int flags, const std::string filename);
-
-    void recognizeObjects(const std::vector<signals::ObjectSignals> & signals, std::vector<Object> & obj);
+    /* RGBA pixels of the reconstructed and the annotated image */
+    std::vector<uint8_t> reconstruction(const Image & img) const;
+    std::vector<uint8_t> annotation(const Image & img, const std::vector<Object> & obj);
+
+    /* Everything learn and recognize do after thresholding. Recognition fills in the */
+    /* result to be cached, if there is one                                           */
+    void learnThresholded(const Image & thresholds, const int flags);
+    std::vector<Object> recognizeThresholded(const Image & thresholds, const int flags, ResultCache::Result * result = nullptr);
+
+    model::Contents contents() const;
+    /* Hash of the model and of everything else which decides the result of recognize */
+    uint64_t configuration(const int flags) const;
+    /* Whether recognize with the flags uses the cache, which holds the images the flags */
+    /* ask for only if it stores images                                                 */
+    bool cached(const int flags) const;
+    /* Returns the cached result of an input whose content hashes to content, otherwise */
+    /* recognizes thresholds() and caches the result                                    */
+    template <typename Thresholds>
+    std::vector<Object> recognizeCached(uint64_t content, const int flags, Thresholds && thresholds);
+    /* Calls label(width, height, rows, threshold) for the rows of a file or an image and */
+    /* classifies the components it returns                                              */
+    template <typename Label>
+    std::vector<Object> recognizeRows(const std::string & filename, const int flags, Label && label);
+    template <typename Label>
+    std::vector<Object> recognizeRows(const ImageView & img, const int flags, Label && label);
+    std::vector<Object> recognizeComponents(const std::vector<tiling::Component> & components, const int flags);
+    std::vector<Object> recognizeRegions(const ImageView & img, const std::vector<roi::Region> & regions, const int flags);
 
 public:
 
+    /* Objects with a shorter perimeter are dropped as noise */
+    static constexpr int minObjectSize = 15;
+
     struct Flags {
         const static int none = 0;
         const static int surfaceRecognition = 1;
         const static int annotateRecognized = 2;
+        const static int quantized = 4;
 
         /* Shortcuts */
         const static int sr = surfaceRecognition;
         const static int ar = annotateRecognized;
+        const static int q = quantized;
     };
 
     ImageAnalyzer();
 
+    void setTrainingOptions(const training::Options & options);
+    void setSelectionOptions(const training::SelectionOptions & options);
+    void setUpdateOptions(const training::UpdateOptions & options);
+
+    /* Replaces the pool of the analyzer, e.g. to share one pool among several analyzers */
+    void setThreadPool(std::shared_ptr<ThreadPool> threadPool);
+    ThreadPool & threadPool() const;
+
+    /* Extensions of the output files are replaced by the one of their format */
+    void setOutputFormats(const output::Formats & formats);
+    void setImageWriter(std::shared_ptr<ImageWriter> imageWriter);
+    /* Waits until written images are on disk, rethrows a failure to write one */
+    void flushOutput();
+
+    /* Memory maps uncompressed BMP, PGM and PPM files instead of reading them row by row */
+    void setMappedInput(bool mapped);
+
+    /* Recognizing an image or a file already recognized with the same model returns the */
+    /* cached result without thresholding or labeling it. Null disables caching.          */
+    void setResultCache(std::shared_ptr<ResultCache> resultCache);
+
     void learn(const sf::Image & img, const int flags = Flags::sr | Flags::ar);
     void learn(const std::string & filename, const int flags = Flags::sr | Flags::ar);
+    /* Frames of external buffers are read in place, e.g. gray frames of a camera */
+    void learn(const ImageView & img, const int flags = Flags::sr | Flags::ar);
 
     std::vector<Object> recognize(const sf::Image & img, const int flags = Flags::sr | Flags::ar);
     std::vector<Object> recognize(const std::string & filename, const int flags = Flags::sr | Flags::ar);
+    std::vector<Object> recognize(const ImageView & img, const int flags = Flags::sr | Flags::ar);
+
+    /* Recognizes objects within regions of interest only, pixels outside of them are */
+    /* background. Rectangles which overlap or touch form a single region, and the    */
+    /* threshold is found over the pixels of every region alone, not over the rest of */
+    /* its bounds. Bounds of objects are in coordinates of the image, neither image   */
+    /* can be written.                                                                */
+    std::vector<Object> recognize(const sf::Image & img, const std::vector<roi::Rect> & rois, const int flags = Flags::none);
+    std::vector<Object> recognize(const ImageView & img, const std::vector<roi::Rect> & rois, const int flags = Flags::none);
+    /* Pixels of the gray mask which are not zero are of interest, the mask is the size of the image */
+    std::vector<Object> recognize(const sf::Image & img, const ImageView & mask, const int flags = Flags::none);
+    std::vector<Object> recognize(const ImageView & img, const ImageView & mask, const int flags = Flags::none);
+
+    /* Adapts the trained network to labeled objects of a new image without retraining, */
+    /* labels are indexed the same way as the objects returned by recognize             */
+    training::EpochReport adapt(const sf::Image & img, const std::vector<size_t> & labels);
+    training::EpochReport adapt(const ImageView & img, const std::vector<size_t> & labels);
+
+    /* Recognizes images too large for memory one strip of tiles at a time. The objects are */
+    /* the same as those of recognize, but neither image can be written. Uncompressed BMP,  */
+    /* PGM and PPM files are memory mapped, other files are loaded by SFML.                 */
+    std::vector<Object> recognizeTiled(const std::string & filename, const tiling::Options & options = {}, const int flags = Flags::none);
+    std::vector<Object> recognizeTiled(const ImageView & img, const tiling::Options & options = {}, const int flags = Flags::none);
+
+    /* Recognizes sparse images coarse to fine. Cells of factor x factor pixels holding */
+    /* foreground are found first, only regions of such cells are labeled at full       */
+    /* resolution. The objects are the same as those of recognize, but neither image    */
+    /* can be written.                                                                  */
+    std::vector<Object> recognizeCoarseToFine(const std::string & filename, uint32_t factor = 4, const int flags = Flags::none);
+    std::vector<Object> recognizeCoarseToFine(const ImageView & img, uint32_t factor = 4, const int flags = Flags::none);
+
+    /* The individual stages of recognize, in the order recognize runs them. Non-const stages */
+    /* of one analyzer must not run concurrently, the pipelined engine uses an analyzer per  */
+    /* such stage                                                                            */
+    Image threshold(const sf::Image & img);
+    Image threshold(const ImageView & img);
+    /* Uncompressed BMP, PGM and PPM files are thresholded while they are decoded, */
+    /* other files are loaded by SFML first                                        */
+    Image threshold(const std::string & filename);
+    /* The threshold the provider finds for the image, brighter pixels are foreground */
+    uint8_t findThreshold(const ImageView & img);
+    Image index(const Image & thresholded);
+    Image filter(const Image & indexed) const;
+    std::vector<signals::ObjectSignals> calcSignals(const Image & img, const int flags) const;
+    void recognizeObjects(const std::vector<signals::ObjectSignals> & signals, std::vector<Object> & obj, const int flags);
+    void reconstructIfDesired(const Image & img, const int flags, const std::string filename) const;
+    void annotateObjectsIfDesired(const Image & img, const std::vector<Object> & obj, const int flags, const std::string filename);
+
+    /* Persist the trained state so that recognition can start without calling learn */
+    void save(const std::string & filename) const;
+    void load(const std::string & filename);
 
 };
 
 
 template <std::uint32_t objects, typename ThresholdProvider>
 ImageAnalyzer<objects, ThresholdProvider>::ImageAnalyzer() {
-    if (not font.loadFromFile("resources/Inconsolata-Regular.ttf")) {
-        throw std::runtime_error("Font could not be loaded.");
+
+    // Adam converges in a few hundred epochs on our signals, whereas plain SGD often needs tens of thousands
+    trainingOptions.optimizer = training::Optimizer::adam;
+    trainingOptions.learningRate = 0.1;
+    trainingOptions.patience = 1000;
+
+    // The training image holds too few objects to spare any, candidates are compared on the training signals
+    selectionOptions.holdOut = 0.0;
+    selectionOptions.seed = std::random_device()();
+
+    // Replaying the training signals keeps online updates from forgetting the original classes
+    updateOptions.replayCapacity = 256;
+
+    glyphs = std::make_shared<const GlyphAtlas>("resources/Inconsolata-Regular.ttf", 30, 2);
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+void ImageAnalyzer<objects, ThresholdProvider>::setTrainingOptions(const training::Options & options) {
+    trainingOptions = options;
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+void ImageAnalyzer<objects, ThresholdProvider>::setSelectionOptions(const training::SelectionOptions & options) {
+    selectionOptions = options;
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+void ImageAnalyzer<objects, ThresholdProvider>::setUpdateOptions(const training::UpdateOptions & options) {
+    updateOptions = options;
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+void ImageAnalyzer<objects, ThresholdProvider>::setThreadPool(std::shared_ptr<ThreadPool> threadPool) {
+    if (not threadPool) {
+        throw std::runtime_error("Thread pool must not be null");
     }
+
+    pool = std::move(threadPool);
 }
 
 template <std::uint32_t objects, typename ThresholdProvider>
-void ImageAnalyzer<objects, ThresholdProvider>::reconstructIfDesired(const Image & img, const int flags, const std::string file) {
-    if (flags & Flags::surfaceRecognition) {
-        img.reconstruct(colors).saveToFile(file);
+ThreadPool & ImageAnalyzer<objects, ThresholdProvider>::threadPool() const {
+    return pool ? *pool : ThreadPool::shared();
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+void ImageAnalyzer<objects, ThresholdProvider>::setOutputFormats(const output::Formats & formats) {
+    outputFormats = formats;
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+void ImageAnalyzer<objects, ThresholdProvider>::setImageWriter(std::shared_ptr<ImageWriter> imageWriter) {
+    if (not imageWriter) {
+        throw std::runtime_error("Image writer must not be null");
     }
+
+    writer = std::move(imageWriter);
 }
 
 template <std::uint32_t objects, typename ThresholdProvider>
-void ImageAnalyzer<objects, ThresholdProvider>::learn(const std::string & filename, const int flags) {
+void ImageAnalyzer<objects, ThresholdProvider>::flushOutput() {
+    writer->flush();
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+void ImageAnalyzer<objects, ThresholdProvider>::setMappedInput(const bool mapped) {
+    mappedInput = mapped;
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+void ImageAnalyzer<objects, ThresholdProvider>::setResultCache(std::shared_ptr<ResultCache> resultCache) {
+    cache = std::move(resultCache);
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+Image ImageAnalyzer<objects, ThresholdProvider>::threshold(const sf::Image & img) {
+    return threshold(ImageView(img));
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+Image ImageAnalyzer<objects, ThresholdProvider>::threshold(const ImageView & img) {
+    return tc.findThresholds(img, threadPool());
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+uint8_t ImageAnalyzer<objects, ThresholdProvider>::findThreshold(const ImageView & img) {
+    return tc.findThreshold(img);
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+Image ImageAnalyzer<objects, ThresholdProvider>::threshold(const std::string & filename) {
+
+    if (ScanlineReader::canRead(filename)) {
+        return tc.findThresholds(ScanlineReader(filename, mappedInput), threadPool());
+    }
 
     sf::Image img;
     if (not img.loadFromFile(filename)) {
-        throw std::runtime_error("File could not be loaded");
+        throw std::runtime_error("File " + filename + " not found");
     }
 
-    learn(img, flags);
+    return threshold(img);
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+Image ImageAnalyzer<objects, ThresholdProvider>::index(const Image & thresholded) {
+    return idx.assignIndices(thresholded, threadPool());
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+Image ImageAnalyzer<objects, ThresholdProvider>::filter(const Image & indexed) const {
+    return filterBySize(indexed, minObjectSize, threadPool());
 }
 
+template <std::uint32_t objects, typename ThresholdProvider>
+std::vector<uint8_t> ImageAnalyzer<objects, ThresholdProvider>::reconstruction(const Image & img) const {
+    std::vector<uint8_t> pixels(size_t(img.width()) * img.height() * 4);
+    img.reconstruct(colors, pixels.data(), threadPool());
+
+    return pixels;
+}
 
 template <std::uint32_t objects, typename ThresholdProvider>
-std::vector<signals::ObjectSignals> ImageAnalyzer<objects, ThresholdProvider>::calcSignals(const Image & img, const int flags) {
+void ImageAnalyzer<objects, ThresholdProvider>::reconstructIfDesired(const Image & img, const int flags, const std::string file) const {
+    if (flags & Flags::surfaceRecognition) {
+        const auto format = outputFormats.reconstruction;
+        writer->write(output::withExtension(file, format), format, reconstruction(img), img.width(), img.height());
+    }
+}
 
-    const auto signalMap = signals::getSignals(img);
+template <std::uint32_t objects, typename ThresholdProvider>
+void ImageAnalyzer<objects, ThresholdProvider>::learn(const std::string & filename, const int flags) {
+    learnThresholded(threshold(filename), flags);
+}
+
+
+template <std::uint32_t objects, typename ThresholdProvider>
+std::vector<signals::ObjectSignals> ImageAnalyzer<objects, ThresholdProvider>::calcSignals(const Image & img, const int flags) const {
+
+    const auto signalMap = signals::getSignals(img, threadPool());
     
     std::vector<signals::ObjectSignals> sigVec(signalMap.size());
 
@@ -140,112 +383,537 @@ std::vector<signals::ObjectSignals> ImageAnalyzer<objects, ThresholdProvider>::c
 
 template <std::uint32_t objects, typename ThresholdProvider>
 void ImageAnalyzer<objects, ThresholdProvider>::learn(const sf::Image & img, const int flags) {
+    learn(ImageView(img), flags);
+}
 
-    const auto thresholds = tc.findThresholds(img);
-    const auto indexed = idx.assignIndices(thresholds);
-    const auto filtered = filterBySize(indexed, minObjectSize);
+template <std::uint32_t objects, typename ThresholdProvider>
+void ImageAnalyzer<objects, ThresholdProvider>::learn(const ImageView & img, const int flags) {
+    learnThresholded(threshold(img), flags);
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+void ImageAnalyzer<objects, ThresholdProvider>::learnThresholded(const Image & thresholds, const int flags) {
+
+    const auto indexed = index(thresholds);
+    const auto filtered = filter(indexed);
     reconstructIfDesired(filtered, flags, "learning.reconstructed.png");
 
     const auto sigVec = calcSignals(filtered, flags);
-    const auto clusters = KMeans<objects>().cluster(sigVec);
+    const auto clusters = KMeans<objects>().cluster(sigVec, 10, threadPool());
 
     recognizer.learn(clusters);
 
     std::vector<std::vector<double>> signals;
     std::vector<size_t> expected;
 
-    std::cout << "Training neural network..." << std::endl;
+    std::clog << "Training neural network..." << std::endl;
     // Train the neural network
     for (const auto & sig : sigVec) {
         expected.emplace_back(recognizer.recognize(sig));
         signals.emplace_back(std::vector<double> { sig.perimeterAreaRatio, sig.momentOfInertia });
 
     }
-    nn.teach(signals, expected);
 
-    std::cout << "Training completed" << std::endl;
+    normalizer.fit(signals);
+    for (auto & sig : signals) {
+        normalizer.apply(sig);
+    }
+
+    training::Options options = trainingOptions;
+    options.pool = &threadPool();
+
+    training::EpochReport report;
+
+    if (selectionOptions.candidates > 1) {
+        const auto selection = nn.teachBestOf(signals, expected, options, selectionOptions);
+        report = selection.report;
+
+        std::clog << "Selected candidate " << selection.candidate << " of " << selectionOptions.candidates
+                  << " (seed " << selection.seed << ", accuracy " << selection.accuracy
+                  << ", " << selection.cancelled << " cancelled)" << std::endl;
+    } else {
+        report = nn.teach(signals, expected, options);
+    }
+
+    classifier = decltype(classifier)(nn);
+    nn.remember(signals, expected, updateOptions.replayCapacity);
+
+    std::clog << "Training completed after " << report.epoch + 1 << " epochs, loss: " << report.trainingLoss << std::endl;
+
+    quantized.emplace(nn, signals);
+    std::clog << "Quantization - " << QuantizedNetwork::compare(nn, *quantized, signals, expected) << std::endl;
 }
 
 template <std::uint32_t objects, typename ThresholdProvider>
-void ImageAnalyzer<objects, ThresholdProvider>::recognizeObjects(const std::vector<signals::ObjectSignals> & signals, std::vector<Object> & obj) {
+void ImageAnalyzer<objects, ThresholdProvider>::recognizeObjects(const std::vector<signals::ObjectSignals> & signals, std::vector<Object> & obj, const int flags) {
+
+    features.clear();
+    classes.resize(signals.size());
 
     for (const auto & sig : signals) {
-        std::cout << sig.index << " " << sig.momentOfInertia << " " << sig.perimeterAreaRatio << std::endl;
-        std::vector<double> sigs;
-        sigs.emplace_back(sig.perimeterAreaRatio);
-        sigs.emplace_back(sig.momentOfInertia);
-        obj[sig.index].type = nn.predict(sigs); //recognizer.recognize(sig);
+        features.emplace_back(sig.perimeterAreaRatio);
+        features.emplace_back(sig.momentOfInertia);
+    }
+
+    normalizer.apply(features.data(), signals.size());
+
+    if (flags & Flags::quantized) {
+        if (not quantized) {
+            throw std::runtime_error("Quantized recognition requires a calibrated network");
+        }
+        quantized->predictBatch(features.data(), signals.size(), classes.data());
+    } else {
+        classifier.predictBatch(features.data(), signals.size(), classes.data());
+    }
+
+    for (size_t i = 0; i < signals.size(); ++i) {
+        obj[signals[i].index].type = classes[i]; //recognizer.recognize(signals[i]);
     }
 
 }
 
 template <std::uint32_t objects, typename ThresholdProvider>
 std::vector<Object> ImageAnalyzer<objects, ThresholdProvider>::recognize(const sf::Image & img, const int flags) {
+    return recognize(ImageView(img), flags);
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+std::vector<Object> ImageAnalyzer<objects, ThresholdProvider>::recognize(const ImageView & img, const int flags) {
+    if (cached(flags)) {
+        return recognizeCached(ResultCache::hash(img, threadPool()), flags, [&]() { return threshold(img); });
+    }
+
+    return recognizeThresholded(threshold(img), flags);
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+std::vector<Object> ImageAnalyzer<objects, ThresholdProvider>::recognize(const sf::Image & img, const std::vector<roi::Rect> & rois, const int flags) {
+    return recognize(ImageView(img), rois, flags);
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+std::vector<Object> ImageAnalyzer<objects, ThresholdProvider>::recognize(const ImageView & img, const std::vector<roi::Rect> & rois, const int flags) {
+    return recognizeRegions(img, roi::regions(rois, img.width(), img.height()), flags);
+}
 
-    const auto thresholds = tc.findThresholds(img);
-    const auto indexed = idx.assignIndices(thresholds);
-    const auto filtered = filterBySize(indexed, minObjectSize);
-    reconstructIfDesired(filtered, flags, "recognition.reconstructed.png");
+template <std::uint32_t objects, typename ThresholdProvider>
+std::vector<Object> ImageAnalyzer<objects, ThresholdProvider>::recognize(const sf::Image & img, const ImageView & mask, const int flags) {
+    return recognize(ImageView(img), mask, flags);
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+std::vector<Object> ImageAnalyzer<objects, ThresholdProvider>::recognize(const ImageView & img, const ImageView & mask, const int flags) {
+
+    if (mask.width() != img.width() or mask.height() != img.height()) {
+        throw std::runtime_error("Mask must be the size of the image");
+    }
+
+    return recognizeRegions(img, roi::regions(mask, threadPool()), flags);
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+std::vector<Object> ImageAnalyzer<objects, ThresholdProvider>::recognizeRegions(const ImageView & img, const std::vector<roi::Region> & regions, const int flags) {
+
+    if (flags & (Flags::surfaceRecognition | Flags::annotateRecognized)) {
+        throw std::runtime_error("Recognition of regions does not write images");
+    }
+
+    std::vector<tiling::Component> components;
+
+    for (const auto & region : regions) {
+        // The threshold is found over the pixels of the region only, pixels the caller left out
+        // of it must not shift the threshold
+        const auto gray = roi::pixels(img, region);
+        if (gray.empty()) {
+            continue;
+        }
+
+        const uint8_t threshold = tc.findThreshold(ImageView(gray.data(), (uint32_t)gray.size(), 1, 0, PixelFormat::gray8));
+        const auto found = roi::components(img, region, threshold, minObjectSize, threadPool());
+
+        components.insert(components.end(), found.begin(), found.end());
+    }
+
+    // Objects are numbered in the same order as those of the whole image
+    std::sort(components.begin(), components.end(), [](const auto & c1, const auto & c2) {
+        return c1.acc.first < c2.acc.first;
+    });
+
+    return recognizeComponents(components, flags);
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+std::vector<Object> ImageAnalyzer<objects, ThresholdProvider>::recognizeThresholded(const Image & thresholds, const int flags, ResultCache::Result * result) {
+
+    const auto indexed = index(thresholds);
+    const auto filtered = filter(indexed);
+
+    if (result and cache->storesImages() and (flags & Flags::surfaceRecognition)) {
+        result->reconstruction = { filtered.width(), filtered.height(), reconstruction(filtered) };
+
+        const auto format = outputFormats.reconstruction;
+        writer->write(output::withExtension("recognition.reconstructed.png", format), format, result->reconstruction.rgba, filtered.width(), filtered.height());
+    } else {
+        reconstructIfDesired(filtered, flags, "recognition.reconstructed.png");
+    }
 
     const auto sigVec = calcSignals(filtered, flags);
     auto objectVec = extractObjects(filtered);
 
-    recognizeObjects(sigVec, objectVec);
+    recognizeObjects(sigVec, objectVec, flags);
 
-    annotateObjectsIfDesired(indexed, objectVec, flags, "recognition.objects.png");
+    if (result and cache->storesImages() and (flags & Flags::annotateRecognized)) {
+        result->annotation = { indexed.width(), indexed.height(), annotation(indexed, objectVec) };
+
+        const auto format = outputFormats.annotation;
+        writer->write(output::withExtension("recognition.objects.png", format), format, result->annotation.rgba, indexed.width(), indexed.height());
+    } else {
+        annotateObjectsIfDesired(indexed, objectVec, flags, "recognition.objects.png");
+    }
+
+    if (result) {
+        result->objects = objectVec;
+        result->signals = sigVec;
+    }
 
     return objectVec;
 }
 
 template <std::uint32_t objects, typename ThresholdProvider>
-std::vector<Object> ImageAnalyzer<objects, ThresholdProvider>::recognize(const std::string & filename, const int flags) {
+bool ImageAnalyzer<objects, ThresholdProvider>::cached(const int flags) const {
+    return cache and (cache->storesImages() or not (flags & (Flags::surfaceRecognition | Flags::annotateRecognized)));
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+template <typename Thresholds>
+std::vector<Object> ImageAnalyzer<objects, ThresholdProvider>::recognizeCached(const uint64_t content, const int flags, Thresholds && thresholds) {
+
+    const uint64_t key = ResultCache::hash(&content, sizeof(content), configuration(flags));
+
+    // The key covers the images the flags ask for, so a hit holds all of them
+    if (const auto hit = cache->find(key)) {
+        if (flags & Flags::surfaceRecognition) {
+            const auto & r = hit->reconstruction;
+            const auto format = outputFormats.reconstruction;
+            writer->write(output::withExtension("recognition.reconstructed.png", format), format, r.rgba, r.width, r.height);
+        }
+
+        if (flags & Flags::annotateRecognized) {
+            const auto & a = hit->annotation;
+            const auto format = outputFormats.annotation;
+            writer->write(output::withExtension("recognition.objects.png", format), format, a.rgba, a.width, a.height);
+        }
+
+        return hit->objects;
+    }
+
+    ResultCache::Result result;
+    auto objectVec = recognizeThresholded(thresholds(), flags, &result);
+
+    cache->insert(key, std::move(result));
+
+    return objectVec;
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+template <typename Label>
+std::vector<Object> ImageAnalyzer<objects, ThresholdProvider>::recognizeRows(const std::string & filename, const int flags, Label && label) {
+
+    if (ScanlineReader::canRead(filename)) {
+        const ScanlineReader reader(filename, true);
+
+        const auto rows = [&](const uint32_t y, std::vector<uint8_t> & buffer) {
+            return reader.row(y, buffer);
+        };
+
+        return recognizeComponents(label(reader.width(), reader.height(), rows, tc.findThreshold(reader)), flags);
+    }
+
     sf::Image img;
     if (not img.loadFromFile(filename)) {
         throw std::runtime_error("File " + filename + " not found");
     }
 
-    return recognize(img, flags);
+    return recognizeRows(ImageView(img), flags, label);
 }
 
+template <std::uint32_t objects, typename ThresholdProvider>
+template <typename Label>
+std::vector<Object> ImageAnalyzer<objects, ThresholdProvider>::recognizeRows(const ImageView & img, const int flags, Label && label) {
+
+    const auto rows = [&](const uint32_t y, std::vector<uint8_t> &) {
+        return img.crop(0, y, img.width(), 1);
+    };
+
+    return recognizeComponents(label(img.width(), img.height(), rows, tc.findThreshold(img)), flags);
+}
 
 template <std::uint32_t objects, typename ThresholdProvider>
-void ImageAnalyzer<objects, ThresholdProvider>::annotateObjects(const Image & img, const std::vector<Object> & obj, const int flags, const std::string file) {
-    auto rec = img.reconstruct(colors);
+std::vector<Object> ImageAnalyzer<objects, ThresholdProvider>::recognizeComponents(const std::vector<tiling::Component> & components, const int flags) {
 
-    sf::RenderTexture tex;
-    tex.create(rec.getSize().x, rec.getSize().y);
+    std::vector<Object> objectVec(components.size());
+    std::vector<signals::ObjectSignals> sigVec;
 
-    {
-        sf::Texture texture;
-        texture.loadFromImage(rec);
+    for (uint32_t i = 0; i < components.size(); ++i) {
+        const auto & c = components[i];
 
-        tex.draw(sf::Sprite { texture });
+        objectVec[i].id = i;
+        objectVec[i].bounds = { { c.left, c.top }, { c.right, c.bottom } };
+        sigVec.emplace_back(signals::toSignals(i, c.acc));
     }
 
-    for (const auto & o : obj) {
-        sf::Text text;
-        text.setFont(font);
-        text.setCharacterSize(30);
-        text.setFillColor(sf::Color::White);
-        text.setString(std::to_string(o.type));
-        text.setOutlineThickness(2);
-        text.setOutlineColor(sf::Color::Black);
+    recognizeObjects(sigVec, objectVec, flags);
+
+    return objectVec;
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+std::vector<Object> ImageAnalyzer<objects, ThresholdProvider>::recognizeTiled(const std::string & filename, const tiling::Options & options, const int flags) {
+
+    if (flags & (Flags::surfaceRecognition | Flags::annotateRecognized)) {
+        throw std::runtime_error("Tiled recognition does not write images");
+    }
+
+    return recognizeRows(filename, flags, [&](const uint32_t width, const uint32_t height, const tiling::RowReader & rows, const uint8_t threshold) {
+        return tiling::components(width, height, rows, threshold, minObjectSize, options, threadPool());
+    });
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+std::vector<Object> ImageAnalyzer<objects, ThresholdProvider>::recognizeTiled(const ImageView & img, const tiling::Options & options, const int flags) {
+
+    if (flags & (Flags::surfaceRecognition | Flags::annotateRecognized)) {
+        throw std::runtime_error("Tiled recognition does not write images");
+    }
+
+    return recognizeRows(img, flags, [&](const uint32_t width, const uint32_t height, const tiling::RowReader & rows, const uint8_t threshold) {
+        return tiling::components(width, height, rows, threshold, minObjectSize, options, threadPool());
+    });
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+std::vector<Object> ImageAnalyzer<objects, ThresholdProvider>::recognizeCoarseToFine(const std::string & filename, const uint32_t factor, const int flags) {
+
+    if (flags & (Flags::surfaceRecognition | Flags::annotateRecognized)) {
+        throw std::runtime_error("Coarse to fine recognition does not write images");
+    }
+
+    return recognizeRows(filename, flags, [&](const uint32_t width, const uint32_t height, const tiling::RowReader & rows, const uint8_t threshold) {
+        return pyramid::components(width, height, rows, threshold, minObjectSize, factor, threadPool());
+    });
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+std::vector<Object> ImageAnalyzer<objects, ThresholdProvider>::recognizeCoarseToFine(const ImageView & img, const uint32_t factor, const int flags) {
+
+    if (flags & (Flags::surfaceRecognition | Flags::annotateRecognized)) {
+        throw std::runtime_error("Coarse to fine recognition does not write images");
+    }
+
+    return recognizeRows(img, flags, [&](const uint32_t width, const uint32_t height, const tiling::RowReader & rows, const uint8_t threshold) {
+        return pyramid::components(width, height, rows, threshold, minObjectSize, factor, threadPool());
+    });
+}
 
-        text.setOrigin(text.getGlobalBounds().width / 2.f, text.getGlobalBounds().height / 2.f);
-        text.setPosition(
-            o.bounds.leftTop.x + (o.bounds.rightBottom.x - o.bounds.leftTop.x) / 2.f,
-            o.bounds.leftTop.y + (o.bounds.rightBottom.y - o.bounds.leftTop.y) / 2.f
-        );
-        tex.draw(text);
+template <std::uint32_t objects, typename ThresholdProvider>
+training::EpochReport ImageAnalyzer<objects, ThresholdProvider>::adapt(const sf::Image & img, const std::vector<size_t> & labels) {
+    return adapt(ImageView(img), labels);
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+training::EpochReport ImageAnalyzer<objects, ThresholdProvider>::adapt(const ImageView & img, const std::vector<size_t> & labels) {
+
+    const auto thresholds = threshold(img);
+    const auto indexed = index(thresholds);
+    const auto filtered = filter(indexed);
+    const auto sigVec = calcSignals(filtered, Flags::none);
+
+    if (labels.size() != sigVec.size()) {
+        throw std::runtime_error("Number of labels does not match number of objects");
+    }
+
+    std::vector<std::vector<double>> signals;
+    std::vector<size_t> expected;
+
+    for (const auto & sig : sigVec) {
+        if (labels[sig.index] >= objects) {
+            throw std::runtime_error("Label does not name a known class");
+        }
+
+        signals.emplace_back(std::vector<double> { sig.perimeterAreaRatio, sig.momentOfInertia });
+        normalizer.apply(signals.back());
+        expected.emplace_back(labels[sig.index]);
     }
 
-    sf::Image dest = tex.getTexture().copyToImage();
+    const auto report = nn.update(signals, expected, updateOptions);
+
+    // Inference runs on copies of the network, the quantized one keeps its calibrated ranges
+    classifier = decltype(classifier)(nn);
+    if (quantized) {
+        auto ranges = quantized->inputRanges();
+        quantized.emplace(nn, std::move(ranges));
+    }
+
+    return report;
+}
 
-    // For some reason, the output image is flipped, and thus has to be flipped
-    // once more to obtain the proper orientation
-    dest.flipVertically();
+template <std::uint32_t objects, typename ThresholdProvider>
+std::vector<Object> ImageAnalyzer<objects, ThresholdProvider>::recognize(const std::string & filename, const int flags) {
+    if (cached(flags)) {
+        return recognizeCached(ResultCache::hash(filename), flags, [&]() { return threshold(filename); });
+    }
+
+    return recognizeThresholded(threshold(filename), flags);
+}
+
+
+template <std::uint32_t objects, typename ThresholdProvider>
+model::Contents ImageAnalyzer<objects, ThresholdProvider>::contents() const {
+
+    model::Contents contents;
+    contents.objects = objects;
+    contents.minObjectSize = minObjectSize;
+    contents.activation = (std::uint32_t)nn.activationFunction();
+    contents.topology = nn.topology();
+
+    const auto & centroids = recognizer.getCentroids();
+    contents.centroids.assign(centroids.begin(), centroids.end());
+
+    contents.weights.resize(nn.weightCount());
+    nn.exportWeights(contents.weights.data());
+
+    if (quantized) {
+        contents.inputRanges = quantized->inputRanges();
+    }
+
+    contents.normalization = (std::uint32_t)normalizer.getMethod();
+    contents.normalizationOffsets = normalizer.offsets();
+    contents.normalizationScales = normalizer.scales();
+
+    std::vector<size_t> classes(nn.replaySize());
+    contents.replaySignals.resize(nn.replaySize() * nn.topology().front());
+    nn.exportReplay(contents.replaySignals.data(), classes.data());
+    contents.replayClasses.assign(classes.begin(), classes.end());
+    contents.replaySeen = nn.replayOffered();
+
+    return contents;
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+uint64_t ImageAnalyzer<objects, ThresholdProvider>::configuration(const int flags) const {
+
+    const auto model = contents();
+
+    const uint64_t settings[] = {
+        model::version, objects, uint64_t(minObjectSize),
+        uint64_t(flags & (Flags::quantized | Flags::surfaceRecognition | Flags::annotateRecognized)),
+        model.activation, model.normalization
+    };
+    const std::string provider = typeid(ThresholdProvider).name();
+
+    // Every part of the model is chained into the hash of the one before it
+    uint64_t h = ResultCache::hash(settings, sizeof(settings));
+    h = ResultCache::hash(provider.data(), provider.size(), h);
+    h = ResultCache::hash(model.topology.data(), model.topology.size() * sizeof(size_t), h);
+    h = ResultCache::hash(model.centroids.data(), model.centroids.size() * sizeof(Centroid), h);
+    h = ResultCache::hash(model.weights.data(), model.weights.size() * sizeof(double), h);
+    h = ResultCache::hash(model.inputRanges.data(), model.inputRanges.size() * sizeof(double), h);
+    h = ResultCache::hash(model.normalizationOffsets.data(), model.normalizationOffsets.size() * sizeof(double), h);
+    h = ResultCache::hash(model.normalizationScales.data(), model.normalizationScales.size() * sizeof(double), h);
+
+    return h;
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+void ImageAnalyzer<objects, ThresholdProvider>::save(const std::string & filename) const {
+    model::save(filename, contents());
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+void ImageAnalyzer<objects, ThresholdProvider>::load(const std::string & filename) {
+
+    const model::MappedModel mapped(filename);
+    const auto & header = mapped.header();
+
+    if (header.objects != objects or header.minObjectSize != minObjectSize) {
+        throw std::runtime_error("Model " + filename + " was trained with a different configuration");
+    }
+    if (header.activation != (std::uint32_t)nn.activationFunction()) {
+        throw std::runtime_error("Model " + filename + " was trained with a different activation function");
+    }
+    if (mapped.topology() != nn.topology() or header.weightCount != nn.weightCount()) {
+        throw std::runtime_error("Model " + filename + " does not match the network topology");
+    }
+
+    // Normalization steps through the signals by its number of features, which must be the number of inputs
+    const bool unnormalized = header.normalization == (std::uint32_t)normalization::Method::none;
+    if (header.featureCount != nn.topology().front() and (header.featureCount or not unnormalized)) {
+        throw std::runtime_error("Model " + filename + " does not match the number of network inputs");
+    }
+
+    std::array<Centroid, objects> centroids;
+    for (std::uint32_t i = 0; i < objects; ++i) {
+        centroids[i] = mapped.centroid(i);
+    }
+
+    recognizer.setCentroids(centroids);
+    normalizer = Normalizer(
+        (normalization::Method)header.normalization,
+        mapped.normalizationOffsets(),
+        mapped.normalizationScales()
+    );
+    nn.importWeights(mapped.weights());
+    classifier = decltype(classifier)(nn);
+
+    // The replay buffer is restored, so that adapt keeps replaying the samples of the training
+    const std::vector<size_t> replayed(mapped.replayClasses(), mapped.replayClasses() + header.replayCount);
+    nn.importReplay(mapped.replaySignals(), replayed.data(), replayed.size(), header.replaySeen);
+
+    quantized.reset();
+    if (header.rangeCount) {
+        quantized.emplace(nn, mapped.inputRanges());
+    }
+}
+
+
+template <std::uint32_t objects, typename ThresholdProvider>
+void ImageAnalyzer<objects, ThresholdProvider>::annotateObjects(const Image & img, const std::vector<Object> & obj, const int flags, const std::string file) {
+    const auto format = outputFormats.annotation;
+    writer->write(output::withExtension(file, format), format, annotation(img, obj), img.width(), img.height());
+}
+
+template <std::uint32_t objects, typename ThresholdProvider>
+std::vector<uint8_t> ImageAnalyzer<objects, ThresholdProvider>::annotation(const Image & img, const std::vector<Object> & obj) {
+    const uint32_t width = img.width();
+    const uint32_t height = img.height();
+
+    std::vector<uint8_t> pixels(size_t(width) * height * 4);
+    const auto palette = img.palette(colors, threadPool());
+
+    std::vector<std::string> labels;
+    for (const auto & o : obj) {
+        labels.emplace_back(std::to_string(o.type));
+    }
 
-    dest.saveToFile(file);
+    // Every band of rows is reconstructed and labeled in one go while it is still in cache,
+    // overlapping labels are drawn in object order
+    threadPool().parallelFor(0, height, 32, [&](const size_t begin, const size_t end) {
+        img.reconstructRows(palette, pixels.data(), begin, end);
+
+        for (size_t i = 0; i < obj.size(); ++i) {
+            const auto & b = obj[i].bounds;
+
+            glyphs->draw(
+                pixels.data(), width, height, labels[i],
+                b.leftTop.x + (b.rightBottom.x - b.leftTop.x) / 2.f,
+                b.leftTop.y + (b.rightBottom.y - b.leftTop.y) / 2.f,
+                sf::Color::White, sf::Color::Black,
+                begin, end
+            );
+        }
+    });
+
+    return pixels;
 }
 
 template <std::uint32_t objects, typename ThresholdProvider>
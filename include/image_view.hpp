@@ -0,0 +1,92 @@
+#ifndef IMAGE_ANALYSIS_IMAGE_VIEW_HPP
+#define IMAGE_ANALYSIS_IMAGE_VIEW_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <SFML/Graphics.hpp>
+
+#include "util.hpp"
+
+
+enum class PixelFormat {
+    gray8,
+    rgb24,
+    rgba32,
+    bgr24,
+    bgra32
+};
+
+uint32_t bytesPerPixel(PixelFormat format);
+
+
+/* Non-owning view of pixels in an external frame buffer, e.g. one filled by a capture  */
+/* library. Rows are stride bytes apart and the buffer must outlive the view.           */
+class ImageView {
+
+    const uint8_t * pixels = nullptr;
+    uint32_t w = 0;
+    uint32_t h = 0;
+    size_t rowStride = 0;
+    PixelFormat fmt = PixelFormat::rgba32;
+
+public:
+
+    /* A stride of 0 stands for tightly packed rows */
+    ImageView(const uint8_t * data, uint32_t width, uint32_t height, size_t stride, PixelFormat format);
+    /* Views the RGBA pixels of an SFML image without copying them */
+    explicit ImageView(const sf::Image & img);
+
+    uint32_t width() const;
+    uint32_t height() const;
+    size_t stride() const;
+    PixelFormat format() const;
+
+    const uint8_t * row(uint32_t y) const;
+
+    /* View of the rectangle at (x, y), which must lie within this view */
+    ImageView crop(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const;
+
+    /* Calls fn(x, luminance) for every pixel of row y. Gray pixels are passed as they are, */
+    /* colors are converted by util::bw.                                                    */
+    template <typename Fn>
+    void scanRow(uint32_t y, Fn && fn) const;
+
+};
+
+
+template <typename Fn>
+void ImageView::scanRow(const uint32_t y, Fn && fn) const {
+    const uint8_t * px = row(y);
+
+    // The format is dispatched once per row, so that the inner loops stay branch free
+    switch (fmt) {
+        case PixelFormat::gray8:
+            for (uint32_t x = 0; x < w; ++x) {
+                fn(x, px[x]);
+            }
+            break;
+        case PixelFormat::rgb24:
+            for (uint32_t x = 0; x < w; ++x, px += 3) {
+                fn(x, util::bw(sf::Color(px[0], px[1], px[2])));
+            }
+            break;
+        case PixelFormat::rgba32:
+            for (uint32_t x = 0; x < w; ++x, px += 4) {
+                fn(x, util::bw(sf::Color(px[0], px[1], px[2])));
+            }
+            break;
+        case PixelFormat::bgr24:
+            for (uint32_t x = 0; x < w; ++x, px += 3) {
+                fn(x, util::bw(sf::Color(px[2], px[1], px[0])));
+            }
+            break;
+        case PixelFormat::bgra32:
+            for (uint32_t x = 0; x < w; ++x, px += 4) {
+                fn(x, util::bw(sf::Color(px[2], px[1], px[0])));
+            }
+            break;
+    }
+}
+
+#endif
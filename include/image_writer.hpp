@@ -0,0 +1,91 @@
+#ifndef IMAGE_ANALYSIS_IMAGE_WRITER_HPP
+#define IMAGE_ANALYSIS_IMAGE_WRITER_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace output {
+
+    enum class Format {
+        /* Deflate compressed, small and readable everywhere */
+        png,
+        /* Uncompressed deflate, larger files but nearly free to encode */
+        storedPng,
+        bmp,
+        ppm,
+        /* The Quite OK Image format, lossless and cheap to encode */
+        qoi
+    };
+
+    /* Format of every image written by the analyzer */
+    struct Formats {
+        Format reconstruction = Format::png;
+        Format annotation = Format::png;
+    };
+
+    /* Parses png, png-stored, bmp, ppm or qoi */
+    Format parseFormat(const std::string & name);
+
+    /* The format named by the extension of the file, PNG when the extension is unknown */
+    Format formatOf(const std::string & filename);
+
+    /* Replaces the extension of the file with the one of the format */
+    std::string withExtension(const std::string & filename, Format format);
+
+    /* Encodes a width x height RGBA buffer */
+    std::vector<uint8_t> encode(Format format, const uint8_t * rgba, uint32_t width, uint32_t height);
+
+    void write(const std::string & filename, Format format, const uint8_t * rgba, uint32_t width, uint32_t height);
+}
+
+
+/* Encodes and writes images on a background thread, so that recognition does not */
+/* wait for the disk. The thread is started by the first image. Producers block    */
+/* while the queue is full. Failures are kept and rethrown by flush.               */
+class ImageWriter {
+
+    struct Job {
+        std::string filename;
+        output::Format format;
+        std::vector<uint8_t> rgba;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    const size_t capacity;
+
+    std::mutex mtx;
+    std::condition_variable changed;
+    std::deque<Job> jobs;
+    bool busy = false;
+    bool stop = false;
+    std::exception_ptr error;
+
+    std::thread worker;
+
+    void work();
+
+public:
+
+    explicit ImageWriter(size_t capacity = 8);
+    ~ImageWriter();
+
+    ImageWriter(const ImageWriter &) = delete;
+    ImageWriter & operator=(const ImageWriter &) = delete;
+
+    /* Queues a width x height RGBA buffer to be written in the given format */
+    void write(std::string filename, output::Format format, std::vector<uint8_t> rgba, uint32_t width, uint32_t height);
+
+    /* Waits until all queued images are written, rethrows the first failure since the last flush */
+    void flush();
+};
+
+
+#endif
@@ -1,26 +1,38 @@
 #ifndef IMAGE_ANALYSIS_INDEXER_HPP
 #define IMAGE_ANALYSIS_INDEXER_HPP
 
-#include <functional>
+#include <cstdint>
+#include <vector>
 
 #include "image.hpp"
+#include "thread_pool.hpp"
 
 
+/* Assigns an index to every 4-connected component of foreground pixels. Indices are */
+/* assigned in the order in which the components are first encountered when the     */
+/* image is scanned row after row.                                                   */
 class Indexer {
 
     Image dest;
-    uint32_t idxCounter = 0;
 
-    void assignRecursively(uint32_t x, uint32_t y);
-    void assignIndex(uint32_t x, uint32_t y);
-    void assignIndices();
+    /* Union-find forest over pixels identified by y * width + x. Parents always have */
+    /* a lower identifier, hence the root of a component is its first pixel.          */
+    std::vector<uint32_t> parent;
 
+    bool isForeground(uint32_t x, uint32_t y) const;
+
+    uint32_t find(uint32_t px);
+    uint32_t root(uint32_t px) const;
+    void unite(uint32_t px1, uint32_t px2);
+
+    void labelBand(uint32_t begin, uint32_t end);
 
 public:
 
     Image assignIndices(const Image & img);
+    /* Labels bands of rows in parallel and stitches the bands afterwards */
+    Image assignIndices(const Image & img, ThreadPool & pool);
 
 };
 
 #endif
-
@@ -8,9 +8,12 @@
 #include <array>
 #include <random>
 #include <iostream>
-#include <limits>
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
 
 #include "signals.hpp"
+#include "thread_pool.hpp"
 
 namespace km {
 
@@ -35,13 +38,13 @@ class KMeans {
 
     std::mt19937 mt { std::random_device()() };
 
-    std::array<km::Centroid, clusters> randCentroids(const km::Signals & signals);
+    std::array<km::Centroid, clusters> randCentroids(const km::Signals & signals, std::mt19937 & rng);
     std::array<km::Signals, clusters> distribute(const km::Signals & signals, const std::array<km::Centroid, clusters> & centroids);
     std::array<km::Centroid, clusters> calcCentroids(const std::array<km::Signals, clusters> & signals);
 
     double calcDistSse(const std::array<km::Signals, clusters> & signals, const std::array<km::Centroid, clusters> & centroids);
 
-    std::pair<std::array<km::Centroid, clusters>, std::array<km::Signals, clusters>> runIter(const km::Signals & signals);
+    std::pair<std::array<km::Centroid, clusters>, std::array<km::Signals, clusters>> runIter(const km::Signals & signals, std::mt19937 & rng);
 
     bool containsEmptyCluster(const std::array<km::Signals, clusters> & distribution);
 
@@ -50,16 +53,18 @@ class KMeans {
 public:
 
     std::array<std::vector<signals::ObjectSignals>, clusters> cluster(const std::vector<signals::ObjectSignals> & signals, const int attempts = 10);
+    /* Runs the attempts in parallel, each with its own generator seeded upfront */
+    std::array<std::vector<signals::ObjectSignals>, clusters> cluster(const std::vector<signals::ObjectSignals> & signals, const int attempts, ThreadPool & pool);
 
 };
 
 template <uint64_t clusters>
-std::array<km::Centroid, clusters> KMeans<clusters>::randCentroids(const km::Signals & signals) {
+std::array<km::Centroid, clusters> KMeans<clusters>::randCentroids(const km::Signals & signals, std::mt19937 & rng) {
 
     std::vector<size_t> indices(signals.size());
     std::iota(indices.begin(), indices.end(), 0);
 
-    std::shuffle(indices.begin(), indices.end(), mt);
+    std::shuffle(indices.begin(), indices.end(), rng);
 
     std::array<km::Centroid, clusters> centroids;
 
@@ -154,9 +159,9 @@ bool KMeans<clusters>::arrEq(const std::array<km::Centroid, clusters> & a1, cons
 }
 
 template <uint64_t clusters>
-std::pair<std::array<km::Centroid, clusters>, std::array<km::Signals, clusters>> KMeans<clusters>::runIter(const km::Signals & signals) {
+std::pair<std::array<km::Centroid, clusters>, std::array<km::Signals, clusters>> KMeans<clusters>::runIter(const km::Signals & signals, std::mt19937 & rng) {
 
-    auto centroids = randCentroids(signals);
+    auto centroids = randCentroids(signals, rng);
     std::array<km::Signals, clusters> result;
 
     for (int i = 0; i < km::maxKMIterations; ++i) {
@@ -190,23 +195,40 @@ bool KMeans<clusters>::containsEmptyCluster(const std::array<km::Signals, cluste
 
 template <uint64_t clusters>
 std::array<std::vector<signals::ObjectSignals>, clusters> KMeans<clusters>::cluster(const km::Signals & signals, const int attempts) {
+    return cluster(signals, attempts, ThreadPool::sequential());
+}
 
-    double bestSse = std::numeric_limits<double>::max();
-    std::array<std::vector<signals::ObjectSignals>, clusters> bestIter;
+template <uint64_t clusters>
+std::array<std::vector<signals::ObjectSignals>, clusters> KMeans<clusters>::cluster(const km::Signals & signals, const int attempts, ThreadPool & pool) {
+
+    const size_t count = std::max(attempts, 0);
 
-    for (int i = 0; i < attempts; ++i) {
-        
-        auto [centroids, distribution] = runIter(signals);
+    std::vector<std::mt19937::result_type> seeds(count);
+    std::generate(seeds.begin(), seeds.end(), std::ref(mt));
+
+    std::vector<double> sse(count, std::numeric_limits<double>::max());
+    std::vector<std::array<km::Signals, clusters>> distributions(count);
+
+    pool.run(count, [&](const size_t i) {
+        std::mt19937 rng(seeds[i]);
+        auto [centroids, distribution] = runIter(signals, rng);
 
         if (containsEmptyCluster(distribution)) {
-            continue;
+            return;
         }
 
-        const auto sse = calcDistSse(distribution, centroids);
+        sse[i] = calcDistSse(distribution, centroids);
+        distributions[i] = std::move(distribution);
+    });
+
+    // The first of equally good attempts wins, which keeps the result independent of scheduling
+    double bestSse = std::numeric_limits<double>::max();
+    std::array<std::vector<signals::ObjectSignals>, clusters> bestIter;
 
-        if (sse < bestSse) {
-            bestSse = sse;
-            bestIter = std::move(distribution);
+    for (size_t i = 0; i < count; ++i) {
+        if (sse[i] < bestSse) {
+            bestSse = sse[i];
+            bestIter = std::move(distributions[i]);
         }
     }
 
@@ -218,6 +240,5 @@ std::array<std::vector<signals::ObjectSignals>, clusters> KMeans<clusters>::clus
     return bestIter;
 }
 
-
 #endif
 
@@ -0,0 +1,186 @@
+#ifndef IMAGE_ANALYSIS_LINE_SCANNER_HPP
+#define IMAGE_ANALYSIS_LINE_SCANNER_HPP
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+#include "image_analyzer.hpp"
+#include "image_view.hpp"
+#include "signals.hpp"
+
+
+/* Labels an unbounded stream of rows, keeping only the objects which touch the latest */
+/* row. An object is reported as soon as a row no longer touches it, memory depends on */
+/* the width of the rows only. Rows are counted in 64 bits, while bounds hold 32 bit   */
+/* coordinates, so the stream is split into epochs of epochRows rows and the rows of   */
+/* bounds count from the first row of the epoch in which the object starts.           */
+class RowLabeler {
+
+public:
+
+    static constexpr uint64_t epochRows = uint64_t(1) << 31;
+
+    struct Closed {
+        /* Sums over coordinates relative to the top row of the object */
+        signals::Accumulator acc;
+        /* Rows relative to epoch, which is a multiple of epochRows */
+        Bounds bounds;
+        uint64_t epoch;
+    };
+
+    using Sink = std::function<void(const Closed &)>;
+
+private:
+
+    struct Open {
+        signals::Accumulator acc;
+        uint64_t top;
+        uint32_t left;
+        uint32_t right;
+        uint64_t bottom;
+
+        void merge(const Open & other);
+    };
+
+    const uint32_t width;
+    const uint8_t threshold;
+    const int minPerimeter;
+
+    /* Foreground of the rows above, at and below the row whose pixels are added next */
+    std::vector<uint8_t> above;
+    std::vector<uint8_t> current;
+    std::vector<uint8_t> below;
+
+    /* Object of every pixel of the current row, objects are joined through parent */
+    std::vector<uint32_t> labels;
+    std::vector<Open> objects;
+    std::vector<uint32_t> parent;
+
+    /* Number of the row below, the one pushed last */
+    uint64_t rows = 0;
+
+    uint32_t find(uint32_t object);
+    void unite(uint32_t object1, uint32_t object2);
+
+    void advance(const Sink & sink);
+
+public:
+
+    /* Objects whose perimeter is shorter than minPerimeter are dropped */
+    RowLabeler(uint32_t width, uint8_t threshold, int minPerimeter);
+
+    /* Pixels brighter than the threshold are foreground, every row of the view is pushed */
+    void push(const ImageView & view, const Sink & sink);
+
+    /* Ends the stream, reporting every object which is still open. The next row starts a new stream */
+    void finish(const Sink & sink);
+
+};
+
+
+/* Recognizes objects in the rows of a line-scan camera. Every object is classified by */
+/* the analyzer and handed to the sink together with its signals and the epoch of its  */
+/* bounds as soon as its last row has passed. Ids count the objects of the stream in   */
+/* the order they are reported, modulo 2^32.                                           */
+template <typename Analyzer>
+class LineScanner {
+
+public:
+
+    /* The top row of an object in the stream is epoch + bounds.leftTop.y */
+    using Sink = std::function<void(const Object &, const signals::ObjectSignals &, uint64_t epoch)>;
+
+private:
+
+    Analyzer & analyzer;
+    const uint32_t width;
+    const int flags;
+    Sink sink;
+
+    std::optional<RowLabeler> labeler;
+    uint32_t emitted = 0;
+
+    std::vector<Object> objects;
+    std::vector<signals::ObjectSignals> signals;
+    std::vector<uint64_t> epochs;
+
+    void collect(const RowLabeler::Closed & closed);
+    void classify();
+
+public:
+
+    LineScanner(Analyzer & analyzer, uint32_t width, Sink sink, int flags = Analyzer::Flags::none);
+
+    /* The threshold is found on the first rows pushed */
+    void push(const ImageView & rows);
+    void finish();
+
+};
+
+
+template <typename Analyzer>
+LineScanner<Analyzer>::LineScanner(Analyzer & analyzer, const uint32_t width, Sink sink, const int flags) :
+    analyzer(analyzer), width(width), flags(flags), sink(std::move(sink)) {
+
+    if (flags & (Analyzer::Flags::surfaceRecognition | Analyzer::Flags::annotateRecognized)) {
+        throw std::runtime_error("Line scans do not write images");
+    }
+}
+
+template <typename Analyzer>
+void LineScanner<Analyzer>::collect(const RowLabeler::Closed & closed) {
+    Object object;
+    object.id = emitted++;
+    object.bounds = closed.bounds;
+
+    // Classification looks objects up by the index of their signals
+    signals.emplace_back(signals::toSignals(objects.size(), closed.acc));
+    objects.emplace_back(object);
+    epochs.emplace_back(closed.epoch);
+}
+
+template <typename Analyzer>
+void LineScanner<Analyzer>::classify() {
+    if (objects.empty()) {
+        return;
+    }
+
+    analyzer.recognizeObjects(signals, objects, flags);
+
+    for (size_t i = 0; i < objects.size(); ++i) {
+        signals[i].index = objects[i].id;
+        sink(objects[i], signals[i], epochs[i]);
+    }
+
+    objects.clear();
+    signals.clear();
+    epochs.clear();
+}
+
+template <typename Analyzer>
+void LineScanner<Analyzer>::push(const ImageView & rows) {
+    if (not labeler) {
+        labeler.emplace(width, analyzer.findThreshold(rows), Analyzer::minObjectSize);
+    }
+
+    // Objects closed by the same row are classified together
+    for (uint32_t y = 0; y < rows.height(); ++y) {
+        labeler->push(rows.crop(0, y, rows.width(), 1), [&](const auto & closed) { collect(closed); });
+        classify();
+    }
+}
+
+template <typename Analyzer>
+void LineScanner<Analyzer>::finish() {
+    if (labeler) {
+        labeler->finish([&](const auto & closed) { collect(closed); });
+        classify();
+    }
+
+    emitted = 0;
+}
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef IMAGE_ANALYSIS_MODEL_HPP
+#define IMAGE_ANALYSIS_MODEL_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "recognition.hpp"
+
+
+/* Binary model format                                                          */
+/*                                                                              */
+/* The file consists of a fixed size header followed by six 8-byte aligned      */
+/* sections - layer sizes (uint64), centroids (three doubles each), network     */
+/* weights (doubles), int8 calibration ranges (one double per layer with        */
+/* weights), feature normalization (all offsets followed by all scales) and     */
+/* the replay buffer (all samples as doubles followed by their classes as       */
+/* uint64).                                                                     */
+/* All values are stored in native byte order, which the header records, so    */
+/* that a mapped file can be read in place without parsing.                     */
+namespace model {
+
+    constexpr std::uint32_t version = 5;
+    constexpr std::uint32_t byteOrderMark = 0x01020304;
+
+    struct Header {
+        char magic[4];
+        std::uint32_t version;
+        std::uint32_t byteOrder;
+        std::uint32_t objects;
+        std::uint32_t minObjectSize;
+        std::uint32_t layerCount;
+        std::uint32_t activation;
+        std::uint32_t normalization;
+        std::uint64_t layersOffset;
+        std::uint64_t centroidsOffset;
+        std::uint64_t weightsOffset;
+        std::uint64_t weightCount;
+        std::uint64_t rangesOffset;
+        std::uint64_t rangeCount;
+        std::uint64_t normalizationOffset;
+        std::uint64_t featureCount;
+        std::uint64_t replayOffset;
+        std::uint64_t replayCount;
+        std::uint64_t replaySeen;
+        std::uint64_t fileSize;
+    };
+
+    struct Contents {
+        std::uint32_t objects = 0;
+        std::uint32_t minObjectSize = 0;
+        std::uint32_t activation = 0;
+        std::uint32_t normalization = 0;
+        std::vector<std::size_t> topology;
+        std::vector<Centroid> centroids;
+        std::vector<double> weights;
+        std::vector<double> inputRanges;
+        std::vector<double> normalizationOffsets;
+        std::vector<double> normalizationScales;
+        /* Samples of the replay buffer, one row of topology.front() values each */
+        std::vector<double> replaySignals;
+        std::vector<std::uint64_t> replayClasses;
+        std::uint64_t replaySeen = 0;
+    };
+
+    void save(const std::string & filename, const Contents & contents);
+
+    /* Read-only memory mapping of a model file. The accessors point directly */
+    /* into the mapping and remain valid for the lifetime of the object.      */
+    class MappedModel {
+
+        const std::uint8_t * data = nullptr;
+        std::size_t length = 0;
+
+        void validate() const;
+
+    public:
+
+        MappedModel(const std::string & filename);
+        MappedModel(const MappedModel &) = delete;
+        MappedModel & operator=(const MappedModel &) = delete;
+        ~MappedModel();
+
+        const Header & header() const;
+
+        std::vector<std::size_t> topology() const;
+        Centroid centroid(std::size_t idx) const;
+        const double * weights() const;
+        std::vector<double> inputRanges() const;
+        std::vector<double> normalizationOffsets() const;
+        std::vector<double> normalizationScales() const;
+        const double * replaySignals() const;
+        const std::uint64_t * replayClasses() const;
+    };
+
+}
+
+#endif
@@ -4,90 +4,294 @@
 #include <cstdint>
 #include <cmath>
 #include <vector>
-#include <functional>
+#include <algorithm>
 #include <random>
+#include <stdexcept>
 
-
-struct Neuron {
-    std::vector<double> weights;
-};
+#include "training.hpp"
 
 
+/* A fully connected layer. Weights are stored as a single row-major matrix */
+/* with one row per neuron and one column per neuron of the previous layer. */
+template <typename Scalar>
 struct Layer {
 
-    std::vector<Neuron> neurons;
+    size_t inputs;
+    size_t neurons;
+    std::vector<Scalar> weights;
 
-    Layer(size_t size);
+    Layer(size_t inputs, size_t neurons);
 
     std::size_t size() const;
 
-    const Neuron & operator[](size_t idx) const;
-    Neuron & operator[](size_t idx);
-
-    std::vector<Neuron>::iterator begin();
-    std::vector<Neuron>::iterator end();
-    std::vector<Neuron>::const_iterator begin() const;
-    std::vector<Neuron>::const_iterator end() const;
-    std::vector<Neuron>::const_iterator cbegin() const;
-    std::vector<Neuron>::const_iterator cend() const;
+    const Scalar * row(size_t neuron) const;
+    Scalar * row(size_t neuron);
 };
 
 
+/* Activation functions are compile-time policies. Every policy provides the    */
+/* function itself and its derivative expressed through the neuron output,      */
+/* so that layer kernels instantiated for a policy inline the whole neuron.     */
 namespace activation {
-    typedef std::function<double(double)> Function;
-    typedef Function fn;
 
-    double sigmoid(double potential, double lambda);
-    fn createSigmoid(double lambda);
+    enum class Kind : std::uint32_t {
+        sigmoid = 0,
+        fastSigmoid = 1,
+        tanh = 2,
+        fastTanh = 3
+    };
+
+    struct Sigmoid {
+        static constexpr Kind kind = Kind::sigmoid;
+
+        template <typename T>
+        static T apply(const T potential) {
+            return T(1) / (T(1) + std::exp(-potential));
+        }
+
+        template <typename T>
+        static T derivative(const T output) {
+            return output * (T(1) - output);
+        }
+    };
+
+    struct Tanh {
+        static constexpr Kind kind = Kind::tanh;
+
+        template <typename T>
+        static T apply(const T potential) {
+            return std::tanh(potential);
+        }
+
+        template <typename T>
+        static T derivative(const T output) {
+            return T(1) - output * output;
+        }
+    };
+
+    /* Rational approximation of tanh, exact at 0 and +-3 and saturated outside */
+    /* of that range. Contains no branches or calls and thus vectorizes.       */
+    struct FastTanh {
+        static constexpr Kind kind = Kind::fastTanh;
+
+        template <typename T>
+        static T apply(const T potential) {
+            const T x = std::min(T(3), std::max(T(-3), potential));
+            const T x2 = x * x;
+            return x * (T(27) + x2) / (T(27) + T(9) * x2);
+        }
+
+        template <typename T>
+        static T derivative(const T output) {
+            return T(1) - output * output;
+        }
+    };
+
+    struct FastSigmoid {
+        static constexpr Kind kind = Kind::fastSigmoid;
+
+        template <typename T>
+        static T apply(const T potential) {
+            return T(0.5) + T(0.5) * FastTanh::apply(T(0.5) * potential);
+        }
+
+        template <typename T>
+        static T derivative(const T output) {
+            return output * (T(1) - output);
+        }
+    };
+
+    /* Invokes fn with the policy matching the activation kind */
+    template <typename Fn>
+    void dispatch(const Kind kind, Fn && fn) {
+        switch (kind) {
+            case Kind::sigmoid:
+                return fn(Sigmoid());
+            case Kind::fastSigmoid:
+                return fn(FastSigmoid());
+            case Kind::tanh:
+                return fn(Tanh());
+            case Kind::fastTanh:
+                return fn(FastTanh());
+        }
+
+        throw std::runtime_error("Unknown activation function");
+    }
+
+    /* Lower end of the output range, the target of every output but the expected class */
+    inline double low(const Kind kind) {
+        return (kind == Kind::tanh or kind == Kind::fastTanh) ? -1.0 : 0.0;
+    }
+
 };
 
 
 namespace activ = activation;
 
 
-class BackpropagationNetwork {
-    activ::fn activationFn;
+/* The network is templated on the type of its weights and activations. Both   */
+/* float and double networks are instantiated, a network of one type can be    */
+/* converted to the other, e.g. to train in double and run inference in float. */
+template <typename Scalar>
+class BasicBackpropagationNetwork {
+
+    template <typename>
+    friend class BasicBackpropagationNetwork;
 
-    static constexpr double lambda = 1.0;
-    static constexpr double eta = 0.1;
-    static constexpr double threshold = 0.001;
-    static constexpr int iterations = 100'000; // std::numeric_limits<int>::max();
 
-    std::vector<Layer> layers;
+    activ::Kind activationKind;
+
+    std::vector<Layer<Scalar>> layers;
     std::mt19937 rnd { std::random_device()() };
     std::uniform_real_distribution<> dist { 0.0, 1.0 };
 
-    double neuronOutput(const Neuron & neuron, const std::vector<double> & inputs);
-    double neuronPotential(const Neuron & neuron, const std::vector<double> & inputs);
+    /* Reservoir of past samples replayed by online updates */
+    std::vector<std::vector<Scalar>> replaySignals;
+    std::vector<size_t> replayExpected;
+    size_t replaySeen = 0;
+
+    /* Preallocated buffers - outputs of every layer and errors of every layer */
+    std::vector<std::vector<Scalar>> activations;
+    std::vector<std::vector<Scalar>> errors;
+
+    /* Scratch space of predictBatch, grows to the largest batch and is reused */
+    std::vector<Scalar> batchInput;
+    std::vector<Scalar> batchOutput;
+
+    template <typename Fn>
+    void withActivation(Fn && fn) const;
 
     void initLayer(size_t layer);
 
-    void validateInput(const std::vector<double> & input);
+    void validateInput(const std::vector<Scalar> & input);
 
-    std::vector<double> calcLayerValues(size_t layer, const std::vector<double> & inputs);
+    void calcLayerValues(size_t layer);
+    const std::vector<Scalar> & forward(const std::vector<Scalar> & inputs);
 
-    std::vector<std::vector<double>> outputsOfAllLayers(const std::vector<double> & inputs);
+    double calcNetworkError(const std::vector<Scalar> & signals, size_t expected);
 
-    double calcNetworkError(const std::vector<double> & signals, size_t expected);
+    void calcOutputErrors(size_t expected);
+    void calcHiddenErrors(size_t layer);
 
-    std::vector<double> adjustOutputLayer(const std::vector<double> & inputs, const std::vector<double> & outputs, size_t expected);
+    /* Squared error of a single sample, its gradient is written to gradient */
+    double sampleGradient(const std::vector<Scalar> & signals, size_t expected, std::vector<Scalar> & gradient);
 
-    std::vector<double> adjustHiddenLayer(const std::vector<double> & inputs, const std::vector<double> & outputs, size_t layer, const std::vector<double> & prevErrors);
+    void applyGradient(training::OptimizerState & optimizer, const std::vector<Scalar> & gradient, double rate);
 
-    double teach(const std::vector<double> & signals, size_t expected);
 
-    bool teachIteration(const std::vector<std::vector<double>> & signals, const std::vector<size_t> & expected);
+    /* Mini-batch training - a batch is split into fixed size shards, each shard  */
+    /* computes its gradient as matrix-matrix products into its own buffer and    */
+    /* the shard gradients are summed in shard order, which keeps the result      */
+    /* independent of the number of threads                                      */
+    static constexpr size_t shardSize = 32;
 
-public:
+    struct ShardScratch {
+        std::vector<std::vector<Scalar>> activations;
+        std::vector<std::vector<Scalar>> errors;
+    };
 
-    BackpropagationNetwork(activ::fn fun, size_t input, size_t output, size_t hiddenLayers, size_t hiddenLayerNeurons);
+    ShardScratch createShardScratch() const;
 
-    size_t predict(const std::vector<double> & input);
-    std::vector<double> outputValues(std::vector<double> input);
+    struct BatchError {
+        double max = 0.0;
+        double total = 0.0;
+    };
 
-    void teach(const std::vector<std::vector<double>> & signals, const std::vector<size_t> & expected);
+    BatchError shardGradient(
+        const std::vector<std::vector<Scalar>> & signals,
+        const std::vector<size_t> & expected,
+        size_t begin,
+        size_t end,
+        ShardScratch & scratch,
+        std::vector<Scalar> & gradient
+    ) const;
+
+
+public:
+
+    BasicBackpropagationNetwork(activ::Kind activation, size_t input, size_t output, size_t hiddenLayers, size_t hiddenLayerNeurons);
+
+    template <typename Activation>
+    BasicBackpropagationNetwork(Activation, size_t input, size_t output, size_t hiddenLayers, size_t hiddenLayerNeurons);
+
+    /* Converts the weights of a network with a different scalar type */
+    template <typename Other>
+    explicit BasicBackpropagationNetwork(const BasicBackpropagationNetwork<Other> & other);
+
+    activ::Kind activationFunction() const;
+
+    size_t predict(const std::vector<Scalar> & input);
+
+    /* Classifies count samples stored as a contiguous row-major count x inputs  */
+    /* matrix. The network is evaluated layer by layer over the whole batch and  */
+    /* the predicted classes are written to classes, which must hold count items */
+    void predictBatch(const Scalar * samples, size_t count, size_t * classes);
+    std::vector<Scalar> outputValues(const std::vector<Scalar> & input);
+
+    /* Trains the network, returns the report of the last epoch */
+    training::EpochReport teach(
+        const std::vector<std::vector<Scalar>> & signals,
+        const std::vector<size_t> & expected,
+        const training::Options & options = training::Options()
+    );
+
+    /* Trains candidates initialized with different seeds concurrently and    */
+    /* adopts the weights of the candidate with the best held-out accuracy,   */
+    /* ties are broken by the lower held-out loss                             */
+    training::Selection teachBestOf(
+        const std::vector<std::vector<Scalar>> & signals,
+        const std::vector<size_t> & expected,
+        const training::Options & options,
+        const training::SelectionOptions & selection
+    );
+
+    /* Performs a bounded number of gradient steps on newly observed samples mixed */
+    /* with samples drawn from the replay buffer, the new samples are remembered    */
+    /* afterwards. Returns the report of the last step.                             */
+    training::EpochReport update(
+        const std::vector<std::vector<Scalar>> & signals,
+        const std::vector<size_t> & expected,
+        const training::UpdateOptions & options = training::UpdateOptions()
+    );
+
+    /* Adds samples to the replay buffer holding at most capacity samples, once full */
+    /* every sample seen so far is kept with the same probability                    */
+    void remember(const std::vector<std::vector<Scalar>> & signals, const std::vector<size_t> & expected, size_t capacity);
+
+    /* Draws new initial weights from a generator seeded with seed */
+    void initialize(unsigned seed);
+
+    /* Mean squared error over labeled samples */
+    double loss(const std::vector<std::vector<Scalar>> & signals, const std::vector<size_t> & expected);
+    double accuracy(const std::vector<std::vector<Scalar>> & signals, const std::vector<size_t> & expected);
+
+    /* Persistence - weights are exported layer by layer, neuron by neuron */
+    std::vector<size_t> topology() const;
+    size_t weightCount() const;
+    void exportWeights(Scalar * dest) const;
+    void importWeights(const Scalar * src);
+
+    /* The replay buffer is exported as a row-major matrix of samples and their classes, */
+    /* seen counts every sample offered to it, which keeps the reservoir uniform         */
+    size_t replaySize() const;
+    size_t replayOffered() const;
+    void exportReplay(Scalar * signals, size_t * expected) const;
+    void importReplay(const Scalar * signals, const size_t * expected, size_t count, size_t seen);
 
 };
 
-#endif
 
+typedef BasicBackpropagationNetwork<double> BackpropagationNetwork;
+
+
+template <typename Scalar>
+template <typename Activation>
+BasicBackpropagationNetwork<Scalar>::BasicBackpropagationNetwork(
+        Activation,
+        const size_t input,
+        const size_t output,
+        const size_t hiddenLayers,
+        const size_t hiddenLayerNeurons
+    ) : BasicBackpropagationNetwork(Activation::kind, input, output, hiddenLayers, hiddenLayerNeurons) { }
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef IMAGE_ANALYSIS_NORMALIZATION_HPP
+#define IMAGE_ANALYSIS_NORMALIZATION_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+
+namespace normalization {
+
+    enum class Method : std::uint32_t {
+        /* Features are passed through unchanged */
+        none = 0,
+        /* Zero mean and unit variance of every feature */
+        standard = 1,
+        /* Every feature is mapped onto the [0, 1] range */
+        minMax = 2
+    };
+
+}
+
+
+/* Feature preprocessing fitted on the training signals. Every feature is */
+/* transformed as (x - offset) * scale, so that the same transformation   */
+/* can be stored with the model and applied to signals at recognition.    */
+class Normalizer {
+
+    normalization::Method method = normalization::Method::none;
+    std::vector<double> offset;
+    std::vector<double> scale;
+
+public:
+
+    Normalizer() = default;
+    Normalizer(normalization::Method method);
+    Normalizer(normalization::Method method, std::vector<double> offset, std::vector<double> scale);
+
+    void fit(const std::vector<std::vector<double>> & samples);
+
+    void apply(std::vector<double> & sample) const;
+
+    /* Transforms count samples stored as a contiguous row-major matrix */
+    template <typename T>
+    void apply(T * samples, size_t count) const;
+
+    normalization::Method getMethod() const;
+    const std::vector<double> & offsets() const;
+    const std::vector<double> & scales() const;
+};
+
+
+template <typename T>
+void Normalizer::apply(T * samples, const size_t count) const {
+    const size_t features = offset.size();
+
+    for (size_t i = 0; i < count; ++i) {
+        T * sample = samples + i * features;
+
+        for (size_t f = 0; f < features; ++f) {
+            sample[f] = (sample[f] - offset[f]) * scale[f];
+        }
+    }
+}
+
+#endif
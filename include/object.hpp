@@ -0,0 +1,26 @@
+#ifndef IMAGE_ANALYSIS_OBJECT_HPP
+#define IMAGE_ANALYSIS_OBJECT_HPP
+
+#include <cstdint>
+
+
+struct Point {
+    uint32_t x;
+    uint32_t y;
+};
+
+struct Bounds {
+    Point leftTop;
+    Point rightBottom;
+};
+
+struct Object {
+    static constexpr std::uint32_t noType = -1;
+
+    uint32_t id;
+    Bounds bounds;
+    std::uint32_t type = noType;
+};
+
+
+#endif
@@ -0,0 +1,202 @@
+#ifndef IMAGE_ANALYSIS_PIPELINE_HPP
+#define IMAGE_ANALYSIS_PIPELINE_HPP
+
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+#include "bounded_queue.hpp"
+#include "image_analyzer.hpp"
+
+
+namespace pipeline {
+
+    /* A single image travelling through the stages */
+    struct Frame {
+        size_t sequence = 0;
+        /* Prefix of the files written when reconstruction or annotation is requested */
+        std::string name;
+        sf::Image image;
+
+        Image thresholded;
+        Image indexed;
+        Image filtered;
+        std::vector<signals::ObjectSignals> signals;
+        std::vector<Object> objects;
+
+        /* Set by the stage which failed, the following stages pass the frame on untouched */
+        std::string error;
+    };
+
+    /* Fills in name and image of the next frame, returns false at the end of the stream */
+    typedef std::function<bool(Frame &)> Source;
+    typedef std::function<void(Frame &)> Sink;
+
+    /* Source decoding the given image files in order */
+    Source files(const std::vector<std::string> & filenames);
+}
+
+
+/* Runs the stages of ImageAnalyzer::recognize on dedicated threads connected by  */
+/* bounded queues, so that decoding of a frame overlaps with labeling of the one  */
+/* before it and annotation of the one before that. Each stage owns a copy of the */
+/* trained analyzer, so no two threads touch the same analyzer. Frames reach the  */
+/* sink in the order of the source.                                               */
+template <typename Analyzer>
+class Pipeline {
+
+    typedef std::unique_ptr<pipeline::Frame> FramePtr;
+    typedef BoundedQueue<FramePtr> Queue;
+
+    Analyzer thresholding;
+    Analyzer indexing;
+    Analyzer filtering;
+    Analyzer measuring;
+    Analyzer classification;
+    Analyzer annotation;
+
+    const int flags;
+    const size_t capacity;
+
+    template <typename Fn>
+    static void stage(Queue & in, Queue & out, Fn && fn);
+
+public:
+
+    Pipeline(const Analyzer & trained, int flags, size_t capacity = 4);
+
+    /* Processes frames until the source is exhausted, the sink is called on the calling thread */
+    void run(pipeline::Source source, pipeline::Sink sink);
+};
+
+
+template <typename Analyzer>
+Pipeline<Analyzer>::Pipeline(const Analyzer & trained, const int flags, const size_t capacity) :
+    thresholding(trained),
+    indexing(trained),
+    filtering(trained),
+    measuring(trained),
+    classification(trained),
+    annotation(trained),
+    flags(flags),
+    capacity(capacity) { }
+
+template <typename Analyzer>
+template <typename Fn>
+void Pipeline<Analyzer>::stage(Queue & in, Queue & out, Fn && fn) {
+
+    // A null frame marks the end of the stream and is passed on
+    for (FramePtr frame = in.pop(); frame; frame = in.pop()) {
+        if (frame->error.empty()) {
+            try {
+                fn(*frame);
+            } catch (const std::exception & e) {
+                frame->error = e.what();
+            }
+        }
+
+        out.push(std::move(frame));
+    }
+
+    out.push(nullptr);
+}
+
+template <typename Analyzer>
+void Pipeline<Analyzer>::run(pipeline::Source source, pipeline::Sink sink) {
+
+    constexpr size_t stages = 7;
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    for (size_t i = 0; i < stages; ++i) {
+        queues.emplace_back(std::make_unique<Queue>(capacity));
+    }
+
+    std::vector<std::thread> threads;
+
+    threads.emplace_back([&]() {
+        for (size_t sequence = 0; ; ++sequence) {
+            auto frame = std::make_unique<pipeline::Frame>();
+            frame->sequence = sequence;
+            frame->name = "frame" + std::to_string(sequence);
+
+            try {
+                if (not source(*frame)) {
+                    break;
+                }
+            } catch (const std::exception & e) {
+                frame->error = e.what();
+            }
+
+            queues[0]->push(std::move(frame));
+        }
+
+        queues[0]->push(nullptr);
+    });
+
+    threads.emplace_back([&]() {
+        stage(*queues[0], *queues[1], [&](pipeline::Frame & frame) {
+            frame.thresholded = thresholding.threshold(frame.image);
+        });
+    });
+
+    threads.emplace_back([&]() {
+        stage(*queues[1], *queues[2], [&](pipeline::Frame & frame) {
+            frame.indexed = indexing.index(frame.thresholded);
+        });
+    });
+
+    threads.emplace_back([&]() {
+        stage(*queues[2], *queues[3], [&](pipeline::Frame & frame) {
+            frame.filtered = filtering.filter(frame.indexed);
+            filtering.reconstructIfDesired(frame.filtered, flags, frame.name + ".reconstructed.png");
+        });
+    });
+
+    threads.emplace_back([&]() {
+        stage(*queues[3], *queues[4], [&](pipeline::Frame & frame) {
+            frame.signals = measuring.calcSignals(frame.filtered, flags);
+            frame.objects = extractObjects(frame.filtered);
+        });
+    });
+
+    threads.emplace_back([&]() {
+        stage(*queues[4], *queues[5], [&](pipeline::Frame & frame) {
+            classification.recognizeObjects(frame.signals, frame.objects, flags);
+        });
+    });
+
+    threads.emplace_back([&]() {
+        stage(*queues[5], *queues[6], [&](pipeline::Frame & frame) {
+            annotation.annotateObjectsIfDesired(frame.indexed, frame.objects, flags, frame.name + ".objects.png");
+        });
+    });
+
+    // The stream is drained even if the sink fails, otherwise the stages would wait forever
+    std::exception_ptr failure;
+
+    for (FramePtr frame = queues.back()->pop(); frame; frame = queues.back()->pop()) {
+        try {
+            if (not failure) {
+                sink(*frame);
+            }
+        } catch (...) {
+            failure = std::current_exception();
+        }
+    }
+
+    for (auto & thread : threads) {
+        thread.join();
+    }
+
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+}
+
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef IMAGE_ANALYSIS_PYRAMID_HPP
+#define IMAGE_ANALYSIS_PYRAMID_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "thread_pool.hpp"
+#include "tiling.hpp"
+
+
+/* Coarse-to-fine labeling of sparse images. A coarse level of the image counts the    */
+/* foreground pixels of every cell of factor x factor pixels. Connected cells form the */
+/* regions which may hold objects, only those regions are labeled at full resolution.  */
+namespace pyramid {
+
+    /* Foreground pixels per cell, the level is set wherever a count is not zero */
+    class Level {
+
+        uint32_t factor;
+        uint32_t cellsPerRow;
+        uint32_t cellRows;
+        std::vector<uint32_t> counts;
+
+    public:
+
+        Level(uint32_t width, uint32_t height, const tiling::RowReader & rows, uint8_t threshold, uint32_t factor, ThreadPool & pool);
+
+        uint32_t width() const;
+        uint32_t height() const;
+        uint32_t scale() const;
+
+        uint32_t count(uint32_t x, uint32_t y) const;
+    };
+
+    /* Bounds of a region in cells and the number of foreground pixels it holds */
+    struct Region {
+        uint32_t left;
+        uint32_t top;
+        uint32_t right;
+        uint32_t bottom;
+        uint64_t foreground;
+    };
+
+    /* Regions of 4-connected cells, and the region of every cell, Pixel::noIndex if it is not set */
+    std::vector<Region> regions(const Level & level, std::vector<uint32_t> & cells);
+
+    /* The same objects as tiling::components. Regions with fewer foreground pixels than */
+    /* minPerimeter can not hold such an object and are skipped without being labeled.  */
+    std::vector<tiling::Component> components(
+        uint32_t width, uint32_t height, const tiling::RowReader & rows,
+        uint8_t threshold, int minPerimeter, uint32_t factor, ThreadPool & pool
+    );
+}
+
+
+#endif
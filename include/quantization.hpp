@@ -0,0 +1,82 @@
+#ifndef IMAGE_ANALYSIS_QUANTIZATION_HPP
+#define IMAGE_ANALYSIS_QUANTIZATION_HPP
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "neural_network.hpp"
+
+
+namespace quantization {
+
+    struct Report {
+        size_t samples = 0;
+        /* Share of samples classified as expected by each variant of the network */
+        double doubleAccuracy = 0.0;
+        double floatAccuracy = 0.0;
+        double int8Accuracy = 0.0;
+        /* Share of samples the int8 network classifies the same way as the double one */
+        double agreement = 0.0;
+        /* Largest absolute difference between double and int8 outputs */
+        double maxOutputError = 0.0;
+    };
+
+    std::ostream & operator<<(std::ostream & os, const Report & report);
+
+}
+
+
+/* Post-training int8 quantization of a trained network. Weights are quantized   */
+/* symmetrically with one scale per neuron. Inputs of every layer are quantized  */
+/* with a single scale derived from the largest absolute input value observed    */
+/* while running the calibration signals through the original network. Dot      */
+/* products are accumulated in 32-bit integers and rescaled before activation.  */
+class QuantizedNetwork {
+
+    struct QuantizedLayer {
+        size_t inputs;
+        size_t neurons;
+        std::vector<std::int8_t> weights;
+        std::vector<float> weightScales;
+        float inputScale;
+    };
+
+    activ::Kind activationKind;
+    std::vector<QuantizedLayer> layers;
+    std::vector<double> ranges;
+
+    /* Scratch space reused by every prediction */
+    std::vector<std::int8_t> quantized;
+    std::vector<float> values;
+
+    void quantizeLayers(const BackpropagationNetwork & trained);
+
+    const std::vector<float> & forward(const float * input);
+
+public:
+
+    /* Calibrates the input ranges of every layer using the given signals */
+    QuantizedNetwork(const BackpropagationNetwork & trained, const std::vector<std::vector<double>> & calibration);
+
+    /* Uses input ranges obtained from a previous calibration, one per layer with weights */
+    QuantizedNetwork(const BackpropagationNetwork & trained, std::vector<double> inputRanges);
+
+    const std::vector<double> & inputRanges() const;
+
+    std::vector<float> outputValues(const std::vector<float> & input);
+    size_t predict(const std::vector<float> & input);
+
+    /* Same contract as BackpropagationNetwork::predictBatch */
+    void predictBatch(const float * samples, size_t count, size_t * classes);
+
+    /* Compares the accuracy of the double, float and int8 networks on labeled signals */
+    static quantization::Report compare(
+        const BackpropagationNetwork & reference,
+        QuantizedNetwork & quantized,
+        const std::vector<std::vector<double>> & signals,
+        const std::vector<size_t> & expected
+    );
+};
+
+#endif
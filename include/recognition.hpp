@@ -49,6 +49,9 @@ public:
     std::vector<std::uint32_t> recognize(const std::vector<signals::ObjectSignals> & signals);
 
     bool untrained();
+
+    const std::array<Centroid, objects> & getCentroids() const;
+    void setCentroids(const std::array<Centroid, objects> & centroids);
 };
 
 
@@ -62,6 +65,16 @@ bool Recognizer<objects>::untrained() {
     return true;
 }
 
+template <std::uint32_t objects>
+const std::array<Centroid, objects> & Recognizer<objects>::getCentroids() const {
+    return centroids;
+}
+
+template <std::uint32_t objects>
+void Recognizer<objects>::setCentroids(const std::array<Centroid, objects> & ct) {
+    centroids = ct;
+}
+
 template <std::uint32_t objects>
 Recognizer<objects>::Recognizer(const std::array<Centroid, objects> & ct) : centroids(ct) { }
 
@@ -0,0 +1,104 @@
+#ifndef IMAGE_ANALYSIS_RESULT_CACHE_HPP
+#define IMAGE_ANALYSIS_RESULT_CACHE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "image_view.hpp"
+#include "object.hpp"
+#include "signals.hpp"
+#include "thread_pool.hpp"
+
+
+/* Results of recognition keyed by the content of the input and the version of the     */
+/* model and configuration that recognized it. Recently used results are kept in memory */
+/* up to a number of bytes, and every result is also written to a directory, if one is  */
+/* given, so that later runs find it. The directory is kept within a number of bytes as */
+/* well. Shared by copies of an analyzer, so thread-safe.                               */
+class ResultCache {
+
+public:
+
+    struct Options {
+        /* Bytes of results kept in memory, the least recently used are evicted first */
+        size_t capacity = size_t(256) << 20;
+        /* Results are persisted here, empty keeps them in memory only */
+        std::string directory;
+        /* Bytes of results kept in the directory, the least recently used are removed first */
+        uint64_t diskCapacity = uint64_t(1) << 30;
+        /* Reconstructed and annotated images are kept along with the objects, which makes */
+        /* results far larger. Without them, recognition writing images skips the cache.   */
+        bool images = false;
+    };
+
+    /* RGBA pixels of a rendered image, empty if it was not rendered */
+    struct Rendered {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<uint8_t> rgba;
+    };
+
+    struct Result {
+        std::vector<Object> objects;
+        std::vector<signals::ObjectSignals> signals;
+        Rendered reconstruction;
+        Rendered annotation;
+    };
+
+private:
+
+    const Options options;
+
+    std::mutex mtx;
+    /* Most recently used first */
+    std::list<std::pair<uint64_t, Result>> entries;
+    std::unordered_map<uint64_t, std::list<std::pair<uint64_t, Result>>::iterator> index;
+    size_t bytes = 0;
+
+    /* Files of the directory, most recently used first */
+    std::list<std::pair<uint64_t, uint64_t>> files;
+    std::unordered_map<uint64_t, std::list<std::pair<uint64_t, uint64_t>>::iterator> fileIndex;
+    uint64_t diskBytes = 0;
+
+    std::atomic<size_t> hitCount { 0 };
+    std::atomic<size_t> missCount { 0 };
+
+    std::string path(uint64_t key) const;
+    bool read(uint64_t key, Result & result) const;
+    void remember(uint64_t key, Result result);
+
+    /* Records use of a file of the given size, a size of zero forgets the file. Returns */
+    /* the files to remove to stay within the disk capacity.                             */
+    std::vector<std::string> touch(uint64_t key, uint64_t size);
+
+public:
+
+    ResultCache();
+    explicit ResultCache(const Options & options);
+
+    /* Hashes of the pixels of an image, of the bytes of a file and of arbitrary bytes, */
+    /* chained through the seed                                                         */
+    static uint64_t hash(const ImageView & img, ThreadPool & pool);
+    static uint64_t hash(const std::string & filename);
+    static uint64_t hash(const void * data, size_t size, uint64_t seed = 0);
+
+    bool storesImages() const;
+
+    /* Looks the key up in memory first, then in the directory */
+    std::optional<Result> find(uint64_t key);
+    void insert(uint64_t key, Result result);
+
+    size_t hits() const;
+    size_t misses() const;
+
+};
+
+
+#endif
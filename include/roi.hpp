@@ -0,0 +1,52 @@
+#ifndef IMAGE_ANALYSIS_ROI_HPP
+#define IMAGE_ANALYSIS_ROI_HPP
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "image_view.hpp"
+#include "thread_pool.hpp"
+#include "tiling.hpp"
+
+
+/* Regions of interest of an image, e.g. the trays or lanes where parts can appear. Pixels */
+/* outside of them are background, so objects are cut off where they leave a region.      */
+namespace roi {
+
+    struct Rect {
+        uint32_t x;
+        uint32_t y;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    /* Part of the image which is labeled on its own, no object crosses its bounds */
+    struct Region {
+        Rect bounds;
+        /* Whether pixel (x, y) of the image lies within the region */
+        std::function<bool(uint32_t x, uint32_t y)> contains;
+    };
+
+    /* Rectangles which overlap or touch are joined into a single region, all of them are */
+    /* clipped to the image                                                               */
+    std::vector<Region> regions(const std::vector<Rect> & rects, uint32_t width, uint32_t height);
+
+    /* Pixels of a gray mask the size of the image which are not zero. The mask is viewed by */
+    /* the regions, so it must outlive them.                                                 */
+    std::vector<Region> regions(const ImageView & mask, ThreadPool & pool);
+
+    /* Luminance of the pixels of the region as a single gray row, pixels within the bounds */
+    /* but outside of the region are left out                                             */
+    std::vector<uint8_t> pixels(const ImageView & img, const Region & region);
+
+    /* Objects of pixels of the region brighter than the threshold with a perimeter of at */
+    /* least minPerimeter, in coordinates of the image and ordered like filterBySize does  */
+    std::vector<tiling::Component> components(
+        const ImageView & img, const Region & region,
+        uint8_t threshold, int minPerimeter, ThreadPool & pool
+    );
+}
+
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef IMAGE_ANALYSIS_SCANLINE_READER_HPP
+#define IMAGE_ANALYSIS_SCANLINE_READER_HPP
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "image_view.hpp"
+
+
+/* Decodes uncompressed BMP (1, 4, 8, 24 and 32 bit) and binary PGM / PPM files whose  */
+/* maximum value is 255 one scanline at a time, so that an image can be thresholded     */
+/* without decoding all of it into RGBA first. Rows are read from the file as they are  */
+/* needed, or from a memory mapping of the file, which also allows rows to be read in   */
+/* parallel.                                                                            */
+class ScanlineReader {
+
+    struct Header {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t bitsPerPixel = 0;
+        /* Of the pixel data and between rows within the file */
+        size_t offset = 0;
+        size_t stride = 0;
+        bool bottomUp = false;
+        PixelFormat format = PixelFormat::gray8;
+        /* Luminance of every palette entry, paletted rows are decoded to gray */
+        bool paletted = false;
+        std::array<uint8_t, 256> luminance { };
+    };
+
+    /* False if the file is not an image this reader supports */
+    static bool readHeader(std::istream & in, Header & header);
+
+    std::string filename;
+    Header header;
+
+    const uint8_t * mapping = nullptr;
+    size_t mappingSize = 0;
+
+    size_t rowOffset(uint32_t y) const;
+    ImageView decode(const uint8_t * src, std::vector<uint8_t> & buffer) const;
+
+public:
+
+    static bool canRead(const std::string & filename);
+
+    explicit ScanlineReader(const std::string & filename, bool mapped = false);
+    ~ScanlineReader();
+
+    ScanlineReader(const ScanlineReader &) = delete;
+    ScanlineReader & operator=(const ScanlineReader &) = delete;
+
+    uint32_t width() const;
+    uint32_t height() const;
+    bool mapped() const;
+
+    /* Calls fn(y, row) for every row in the order of the file, row views a single row */
+    void scan(const std::function<void(uint32_t, const ImageView &)> & fn) const;
+
+    /* Row y, decoded into the buffer if necessary. Safe to call concurrently with different */
+    /* buffers. Rows of a file which is not mapped are read into the buffer one at a time.   */
+    ImageView row(uint32_t y, std::vector<uint8_t> & buffer) const;
+
+};
+
+#endif
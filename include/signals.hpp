@@ -2,9 +2,12 @@
 #define IMAGE_ANALYSIS_SIGNALS_HPP
 
 #include <unordered_map>
+#include <vector>
 #include <cstdint>
+#include <limits>
 
 #include "image.hpp"
+#include "thread_pool.hpp"
 
 
 namespace signals {
@@ -15,11 +18,35 @@ namespace signals {
         double momentOfInertia;
     };
 
+    /* Integer sums over the pixels of a single object. The sums of disjoint parts of */
+    /* an image add up exactly to the sums of the whole image, regardless of order.   */
+    struct Accumulator {
+        uint64_t area = 0;
+        uint64_t sumX = 0;
+        uint64_t sumY = 0;
+        uint64_t sumXX = 0;
+        uint64_t sumYY = 0;
+        uint64_t sumXY = 0;
+        /* Pixels with a 4-neighbour outside of the object or the image */
+        uint64_t perimeter = 0;
+        /* Position of the first pixel of the object in column-major order, x * height + y */
+        uint64_t first = std::numeric_limits<uint64_t>::max();
+
+        void addPixel(uint32_t x, uint32_t y, uint32_t height, bool boundary);
+        void merge(const Accumulator & other);
+    };
+
+    /* Accumulators of all objects of an indexed image, indexed by object index */
+    std::vector<Accumulator> accumulate(const Image & img, ThreadPool & pool);
+
+    ObjectSignals toSignals(uint32_t index, const Accumulator & acc);
+
     std::unordered_map<uint32_t, ObjectSignals> getSignals(const Image & img);
+    std::unordered_map<uint32_t, ObjectSignals> getSignals(const Image & img, ThreadPool & pool);
 
     std::unordered_map<uint32_t, double> getPerimeters(const Image & img);
+    std::unordered_map<uint32_t, double> getPerimeters(const Image & img, ThreadPool & pool);
 }
 
 
 #endif
-
@@ -0,0 +1,109 @@
+#ifndef IMAGE_ANALYSIS_THREAD_POOL_HPP
+#define IMAGE_ANALYSIS_THREAD_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/* Work-stealing task scheduler shared by all parallel parts of the program. Every  */
+/* worker owns a deque, takes its own tasks from the back and steals from the front */
+/* of the others when it runs dry. A thread waiting for its tasks to finish keeps   */
+/* executing queued tasks, which makes nested parallelism safe - a task may itself  */
+/* call parallelFor or run on the same pool.                                        */
+class ThreadPool {
+
+    struct Queue {
+        std::mutex mtx;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    /* One queue per worker, the last one receives tasks submitted by other threads */
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::atomic<size_t> queued { 0 };
+    std::mutex sleepMtx;
+    std::condition_variable wake;
+    bool stop = false;
+
+    void work(size_t idx);
+
+    /* Index of the queue owned by the calling thread, or the shared queue */
+    size_t home() const;
+
+    void submit(std::function<void()> task);
+    bool runQueued(size_t home);
+
+    /* Runs tasks 0 .. count-1, waiting for all of them and rethrowing the first exception */
+    void execute(size_t count, const std::function<void(size_t)> & task);
+
+public:
+
+    /* The calling thread takes part in the work, threads - 1 workers are started. Zero */
+    /* uses all available cores, pinned binds each worker to a core of its own.        */
+    explicit ThreadPool(size_t threads = 0, bool pinned = false);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool & operator=(const ThreadPool &) = delete;
+
+    /* Number of threads executing tasks, including the calling thread */
+    size_t size() const;
+
+    /* Calls fn(task) for every task in 0 .. count-1 */
+    template <typename Fn>
+    void run(size_t count, Fn && fn);
+
+    /* Splits begin .. end into chunks of at least grain elements and calls fn(chunkBegin, chunkEnd) */
+    template <typename Fn>
+    void parallelFor(size_t begin, size_t end, size_t grain, Fn && fn);
+
+    /* Pool without workers, everything runs on the calling thread */
+    static ThreadPool & sequential();
+
+    /* Pool of all cores, started on first use and shared by everyone who was not given a pool */
+    static ThreadPool & shared();
+};
+
+
+template <typename Fn>
+void ThreadPool::run(const size_t count, Fn && fn) {
+
+    if (count == 1 or workers.empty()) {
+        for (size_t i = 0; i < count; ++i) {
+            fn(i);
+        }
+        return;
+    }
+
+    execute(count, std::function<void(size_t)>(std::ref(fn)));
+}
+
+template <typename Fn>
+void ThreadPool::parallelFor(const size_t begin, const size_t end, const size_t grain, Fn && fn) {
+
+    if (begin >= end) {
+        return;
+    }
+
+    // A few chunks per thread balance uneven chunks without drowning in tasks
+    const size_t length = end - begin;
+    const size_t chunks = std::max<size_t>(1, std::min(length / std::max<size_t>(1, grain), 4 * size()));
+    const size_t chunk = (length + chunks - 1) / chunks;
+
+    run((length + chunk - 1) / chunk, [&](const size_t i) {
+        fn(begin + i * chunk, std::min(end, begin + (i + 1) * chunk));
+    });
+}
+
+
+#endif
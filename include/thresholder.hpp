@@ -3,26 +3,35 @@
 
 #include <SFML/Graphics/Image.hpp>
 #include <utility>
-#include <functional>
-#include <optional>
 
 #include <SFML/Graphics.hpp>
 
 #include "image.hpp"
+#include "image_view.hpp"
+#include "scanline_reader.hpp"
 #include "util.hpp"
+#include "thread_pool.hpp"
 
 
 struct HalfRangeThreshold {
-    uint8_t findThreshold(const sf::Image & img);
+    uint8_t findThreshold(const ImageView & img);
+    /* Reads the whole file once before it is thresholded */
+    uint8_t findThreshold(const ScanlineReader & img);
 };
 
 template <uint8_t threshold>
 struct ConstantThreshold {
-    uint8_t findThreshold(const sf::Image & img);
+    uint8_t findThreshold(const ImageView & img);
+    uint8_t findThreshold(const ScanlineReader & img);
 };
 
 template <uint8_t threshold>
-uint8_t ConstantThreshold<threshold>::findThreshold(const sf::Image &) {
+uint8_t ConstantThreshold<threshold>::findThreshold(const ImageView &) {
+    return threshold;
+}
+
+template <uint8_t threshold>
+uint8_t ConstantThreshold<threshold>::findThreshold(const ScanlineReader &) {
     return threshold;
 }
 
@@ -33,39 +42,95 @@ class Thresholder {
     ThresholdCalculator tc;
 
     Image dest;
-    std::optional<std::reference_wrapper<const sf::Image>> src;
 
-    void performThresholding();
+    void performThresholding(const ImageView & src, ThreadPool & pool);
 
 public:
 
     Image findThresholds(const sf::Image & img);
+    /* Thresholds bands of rows in parallel */
+    Image findThresholds(const sf::Image & img, ThreadPool & pool);
+    /* Reads the pixels straight from the view, without copying them */
+    Image findThresholds(const ImageView & img, ThreadPool & pool);
+    /* Thresholds every scanline as soon as it is decoded, bands of rows are read in */
+    /* parallel when the file is mapped                                              */
+    Image findThresholds(const ScanlineReader & reader, ThreadPool & pool);
+
+    /* The threshold separating the foreground of the input, brighter pixels are foreground */
+    uint8_t findThreshold(const ImageView & img);
+    uint8_t findThreshold(const ScanlineReader & reader);
 
 };
 
 template<typename TC>
-void Thresholder<TC>::performThresholding() {
-    const auto th = tc.findThreshold(src.value().get());
-    
-    for (uint32_t y = 0; y < dest.height(); ++y) {
-        for (uint32_t x = 0; x < dest.width(); ++x) {
-            const auto current = util::bw(src.value().get().getPixel(x, y));
-
-            dest.at(x, y).color = (current <= th) ? Pixel::colorMin : Pixel::colorMax;
+void Thresholder<TC>::performThresholding(const ImageView & src, ThreadPool & pool) {
+    const auto th = tc.findThreshold(src);
+
+    pool.parallelFor(0, dest.height(), 16, [&](const size_t begin, const size_t end) {
+        for (uint32_t y = begin; y < end; ++y) {
+            src.scanRow(y, [&](const uint32_t x, const uint8_t current) {
+                dest.at(x, y).color = (current <= th) ? Pixel::colorMin : Pixel::colorMax;
+            });
         }
-    }
+    });
 }
 
 template<typename TC>
 Image Thresholder<TC>::findThresholds(const sf::Image & img) {
+    return findThresholds(img, ThreadPool::sequential());
+}
 
-    dest = Image(img.getSize().x, img.getSize().y);
-    src = img;
+template<typename TC>
+Image Thresholder<TC>::findThresholds(const sf::Image & img, ThreadPool & pool) {
+    return findThresholds(ImageView(img), pool);
+}
+
+template<typename TC>
+Image Thresholder<TC>::findThresholds(const ImageView & img, ThreadPool & pool) {
 
-    performThresholding();
+    dest = Image(img.width(), img.height());
+
+    performThresholding(img, pool);
 
     return std::move(dest);
 }
 
-#endif
+template<typename TC>
+Image Thresholder<TC>::findThresholds(const ScanlineReader & reader, ThreadPool & pool) {
 
+    dest = Image(reader.width(), reader.height());
+
+    const auto th = tc.findThreshold(reader);
+
+    const auto thresholdRow = [&](const uint32_t y, const ImageView & row) {
+        row.scanRow(0, [&](const uint32_t x, const uint8_t current) {
+            dest.at(x, y).color = (current <= th) ? Pixel::colorMin : Pixel::colorMax;
+        });
+    };
+
+    if (reader.mapped()) {
+        pool.parallelFor(0, dest.height(), 16, [&](const size_t begin, const size_t end) {
+            std::vector<uint8_t> buffer;
+
+            for (uint32_t y = begin; y < end; ++y) {
+                thresholdRow(y, reader.row(y, buffer));
+            }
+        });
+    } else {
+        reader.scan(thresholdRow);
+    }
+
+    return std::move(dest);
+}
+
+template<typename TC>
+uint8_t Thresholder<TC>::findThreshold(const ImageView & img) {
+    return tc.findThreshold(img);
+}
+
+template<typename TC>
+uint8_t Thresholder<TC>::findThreshold(const ScanlineReader & reader) {
+    return tc.findThreshold(reader);
+}
+
+#endif
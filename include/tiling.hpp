@@ -0,0 +1,112 @@
+#ifndef IMAGE_ANALYSIS_TILING_HPP
+#define IMAGE_ANALYSIS_TILING_HPP
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "image_view.hpp"
+#include "signals.hpp"
+#include "thread_pool.hpp"
+
+
+/* Out-of-core labeling of images too large to be held in memory. The image is */
+/* thresholded, labeled and accumulated one strip of tiles at a time. Parts of */
+/* objects crossing the edges of tiles are joined through an equivalence table */
+/* over the labels found along the edges.                                      */
+namespace tiling {
+
+    struct Options {
+        uint32_t tileWidth = 1024;
+        uint32_t tileHeight = 1024;
+    };
+
+    /* Sums and bounding box of a single object */
+    struct Component {
+        signals::Accumulator acc;
+        uint32_t left = -1;
+        uint32_t top = -1;
+        uint32_t right = 0;
+        uint32_t bottom = 0;
+
+        void addPixel(uint32_t x, uint32_t y, uint32_t height, bool boundary);
+        void merge(const Component & other);
+
+        /* Moves a component found in an image of height rows to (x, y) of an image of imageHeight rows */
+        void translate(uint32_t x, uint32_t y, uint32_t height, uint32_t imageHeight);
+
+        /* Same sums and bounds, which makes for the same signals */
+        bool operator==(const Component & other) const;
+    };
+
+    /* Returns row y of the input, the buffer may hold the decoded pixels. Called concurrently */
+    using RowReader = std::function<ImageView(uint32_t y, std::vector<uint8_t> & buffer)>;
+
+    /* Parts of objects within a single tile, numbered in row-major order */
+    struct Tile {
+        uint32_t x = 0;
+        uint32_t y = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<Component> parts;
+        /* Part of every pixel along the edges of the tile, Pixel::noIndex for background */
+        std::vector<uint32_t> top;
+        std::vector<uint32_t> bottom;
+        std::vector<uint32_t> left;
+        std::vector<uint32_t> right;
+    };
+
+    /* Thresholds and labels a tile of the image. The ring of pixels around the tile is read */
+    /* as well, so that pixels on the edges of the tile know whether they lie on a perimeter */
+    Tile label(
+        uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+        uint32_t imageWidth, uint32_t imageHeight,
+        const RowReader & rows, uint8_t threshold
+    );
+
+    /* Joins the parts of tiles into objects through an equivalence table over the labels */
+    /* along the edges of the tiles. Only the bottom edge of the latest strip is kept, and */
+    /* after every strip the objects which do not reach that edge are complete, they are   */
+    /* kept or dropped by their perimeter and removed from the table. The table therefore  */
+    /* holds the objects crossing a single edge rather than every part seen so far.        */
+    class Stitcher {
+
+        const uint64_t minPerimeter;
+
+        std::vector<Component> parts;
+        std::vector<uint32_t> parent;
+        std::vector<uint32_t> above;
+
+        std::vector<Component> finished;
+
+        /* Merges every part into its root, moves complete objects out of the table and */
+        /* renumbers the remaining ones                                                 */
+        void compact();
+
+    public:
+
+        Stitcher(uint32_t width, int minPerimeter);
+
+        /* Adds the next strip of tiles, ordered from left to right */
+        void add(const std::vector<Tile> & strip);
+
+        /* Parts held for objects which are not complete yet */
+        size_t pending() const;
+
+        /* Objects with a perimeter of at least minPerimeter, ordered by their first pixel */
+        /* in column-major order like filterBySize orders them                             */
+        std::vector<Component> objects();
+    };
+
+    /* Objects of pixels brighter than the threshold with a perimeter of at least minPerimeter, */
+    /* ordered by their first pixel in column-major order. These are exactly the objects and   */
+    /* indices which thresholding, Indexer and filterBySize produce for the whole image.        */
+    std::vector<Component> components(
+        uint32_t width, uint32_t height, const RowReader & rows,
+        uint8_t threshold, int minPerimeter,
+        const Options & options, ThreadPool & pool
+    );
+}
+
+
+#endif
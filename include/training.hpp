@@ -0,0 +1,150 @@
+#ifndef IMAGE_ANALYSIS_TRAINING_HPP
+#define IMAGE_ANALYSIS_TRAINING_HPP
+
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <vector>
+
+
+class ThreadPool;
+
+namespace training {
+
+    enum class Optimizer {
+        sgd,
+        momentum,
+        rmsProp,
+        adam
+    };
+
+    enum class Schedule {
+        /* The learning rate never changes */
+        constant,
+        /* The learning rate is multiplied by decayFactor every decaySteps epochs */
+        step,
+        /* Smooth version of step, the rate decays by decayFactor over decaySteps epochs */
+        exponential,
+        /* Cosine annealing from the initial learning rate towards zero at maxEpochs */
+        cosine
+    };
+
+    struct EpochReport {
+        size_t epoch = 0;
+        double learningRate = 0.0;
+        /* Mean squared error of training samples, measured during the epoch */
+        double trainingLoss = 0.0;
+        /* Highest squared error of a single training sample */
+        double maxError = 0.0;
+        /* Mean squared error of held-out samples, NaN if there are none */
+        double validationLoss = std::numeric_limits<double>::quiet_NaN();
+    };
+
+    struct Options {
+        /* Samples per weight update, a batch size of one performs plain per-sample SGD */
+        size_t batchSize = 1;
+        /* Threads computing gradients of a batch, zero uses all threads of the pool */
+        size_t threads = 0;
+        /* Pool running the training, a pool of its own is created when none is given */
+        ThreadPool * pool = nullptr;
+
+        Optimizer optimizer = Optimizer::sgd;
+        double learningRate = 0.1;
+        /* Momentum coefficient, also used as the first moment decay by Adam */
+        double momentum = 0.9;
+        /* Decay of the squared gradient average used by RMSProp and Adam */
+        double squaredDecay = 0.999;
+        double epsilon = 1e-8;
+
+        Schedule schedule = Schedule::constant;
+        double decayFactor = 0.5;
+        size_t decaySteps = 1000;
+
+        /* Training stops once the error of every sample drops below errorThreshold */
+        size_t maxEpochs = 100'000;
+        double errorThreshold = 0.001;
+
+        /* Share of samples held out to detect a plateau of the validation loss. */
+        /* Without held-out samples, the training loss is monitored instead.     */
+        double validationFraction = 0.0;
+        /* Epochs without an improvement of at least minImprovement before the   */
+        /* training is stopped and the best weights restored, zero disables it   */
+        size_t patience = 0;
+        double minImprovement = 1e-6;
+
+        std::function<void(const EpochReport &)> onEpoch;
+        /* Evaluated after every epoch, training stops when it returns true */
+        std::function<bool(const EpochReport &)> stopWhen;
+    };
+
+    /* Trains several candidate networks with different initial weights and keeps the best */
+    struct SelectionOptions {
+        size_t candidates = 4;
+        /* Candidates trained concurrently, zero uses all threads of the pool */
+        size_t threads = 0;
+        /* Seed of the first candidate, candidate i is initialized using seed + i */
+        unsigned seed = 0;
+        /* Share of samples held out to compare candidates, zero compares them on */
+        /* the training samples                                                  */
+        double holdOut = 0.2;
+        /* Every checkpointEpochs epochs, a candidate whose held-out loss is more */
+        /* than cancelFactor times the best loss seen at the same checkpoint is   */
+        /* cancelled, zero disables cancellation                                  */
+        size_t checkpointEpochs = 50;
+        double cancelFactor = 2.0;
+    };
+
+    /* Bounded online update of a trained network from newly observed samples */
+    struct UpdateOptions {
+        /* Gradient steps per update, each over all new samples and the replayed ones */
+        size_t steps = 10;
+        Optimizer optimizer = Optimizer::sgd;
+        double learningRate = 0.05;
+        /* Updating stops once the largest sample error falls below this threshold */
+        double errorThreshold = 0.001;
+        /* Number of past samples kept for replay, zero disables replay */
+        size_t replayCapacity = 0;
+        /* Past samples mixed into every step */
+        size_t replaySamples = 32;
+    };
+
+    struct Selection {
+        size_t candidate = 0;
+        unsigned seed = 0;
+        double accuracy = 0.0;
+        double loss = 0.0;
+        size_t cancelled = 0;
+        EpochReport report;
+    };
+
+    double learningRate(const Options & options, size_t epoch);
+
+    /* Optimizer state over the flattened parameters of a network. Gradients */
+    /* point in the direction of descent, i.e. they are added to parameters. */
+    class OptimizerState {
+
+        Optimizer optimizer;
+        double momentum;
+        double squaredDecay;
+        double epsilon;
+
+        std::vector<double> velocity;
+        std::vector<double> squared;
+        size_t steps = 0;
+
+    public:
+
+        OptimizerState(const Options & options, size_t parameters);
+
+        /* Must be called once before the parameters of a step are updated */
+        void beginStep();
+
+        /* Updates count parameters starting at offset of the flattened parameters, */
+        /* instantiated for float and double parameters                            */
+        template <typename Scalar>
+        void update(Scalar * params, const Scalar * gradient, size_t offset, size_t count, double rate);
+    };
+
+}
+
+#endif
@@ -0,0 +1,174 @@
+#ifndef IMAGE_ANALYSIS_VIDEO_ANALYZER_HPP
+#define IMAGE_ANALYSIS_VIDEO_ANALYZER_HPP
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "image_analyzer.hpp"
+#include "image_view.hpp"
+#include "signals.hpp"
+#include "thread_pool.hpp"
+#include "tiling.hpp"
+
+
+/* Labels consecutive frames of a fixed camera tile by tile. The tiles of the previous */
+/* frame are kept, only tiles whose pixels or ring of neighbouring pixels changed are  */
+/* thresholded and labeled again before all tiles are stitched into objects.           */
+class IncrementalLabeler {
+
+    const tiling::Options options;
+
+    uint32_t width = 0;
+    uint32_t height = 0;
+    PixelFormat format = PixelFormat::gray8;
+    uint8_t threshold = 0;
+
+    /* Packed pixels of the previous frame, only changed tiles are copied */
+    std::vector<uint8_t> previous;
+    /* Tiles of the previous frame, strip by strip */
+    std::vector<std::vector<tiling::Tile>> strips;
+
+    size_t dirty = 0;
+    size_t total = 0;
+
+    bool changed(const ImageView & frame, const tiling::Tile & tile) const;
+
+public:
+
+    explicit IncrementalLabeler(const tiling::Options & options);
+
+    /* The same objects as tiling::components for the frame. Every tile is labeled again */
+    /* if the size, pixel format or threshold of the frame differ from the previous one  */
+    std::vector<tiling::Component> update(const ImageView & frame, uint8_t threshold, int minPerimeter, ThreadPool & pool);
+
+    /* Tiles labeled by the latest update and tiles of the frame */
+    size_t dirtyTiles() const;
+    size_t tiles() const;
+
+    /* Forgets the previous frame */
+    void reset();
+
+};
+
+
+/* Recognizes the frames of a fixed camera. Objects which are the same as in the previous */
+/* frame keep their signals and class, only new or changed objects are classified. The  */
+/* objects of every frame are the same as those recognize returns for it. The cache of   */
+/* classes must be reset after the analyzer learned, adapted or loaded another network.  */
+template <typename Analyzer>
+class VideoAnalyzer {
+
+    Analyzer & analyzer;
+    const int flags;
+
+    IncrementalLabeler labeler;
+
+    /* Objects of the previous frame ordered by their first pixel, with their signals and classes */
+    std::vector<tiling::Component> known;
+    std::vector<signals::ObjectSignals> knownSignals;
+    std::vector<uint32_t> knownTypes;
+
+    size_t classified = 0;
+
+public:
+
+    /* Smaller tiles follow changes more closely, but stitching them costs more */
+    VideoAnalyzer(Analyzer & analyzer, const tiling::Options & options = { 64, 64 }, int flags = Analyzer::Flags::none);
+
+    std::vector<Object> recognize(const ImageView & frame);
+
+    /* Signals of the objects of the latest frame, indexed like the objects */
+    const std::vector<signals::ObjectSignals> & signals() const;
+
+    /* Tiles labeled and objects classified for the latest frame */
+    size_t dirtyTiles() const;
+    size_t classifiedObjects() const;
+
+    void reset();
+
+};
+
+
+template <typename Analyzer>
+VideoAnalyzer<Analyzer>::VideoAnalyzer(Analyzer & analyzer, const tiling::Options & options, const int flags) :
+    analyzer(analyzer), flags(flags), labeler(options) {
+
+    if (flags & (Analyzer::Flags::surfaceRecognition | Analyzer::Flags::annotateRecognized)) {
+        throw std::runtime_error("Video recognition does not write images");
+    }
+}
+
+template <typename Analyzer>
+std::vector<Object> VideoAnalyzer<Analyzer>::recognize(const ImageView & frame) {
+
+    const auto components = labeler.update(frame, analyzer.findThreshold(frame), Analyzer::minObjectSize, analyzer.threadPool());
+
+    std::vector<Object> objectVec(components.size());
+    std::vector<signals::ObjectSignals> sigVec(components.size());
+    std::vector<signals::ObjectSignals> unknown;
+
+    // Both frames order their objects by the first pixel, which pairs unchanged objects in a single pass
+    size_t k = 0;
+
+    for (uint32_t i = 0; i < components.size(); ++i) {
+        const auto & c = components[i];
+
+        objectVec[i].id = i;
+        objectVec[i].bounds = { { c.left, c.top }, { c.right, c.bottom } };
+
+        while (k < known.size() and known[k].acc.first < c.acc.first) {
+            ++k;
+        }
+
+        if (k < known.size() and known[k] == c) {
+            sigVec[i] = knownSignals[k];
+            sigVec[i].index = i;
+            objectVec[i].type = knownTypes[k];
+        } else {
+            sigVec[i] = signals::toSignals(i, c.acc);
+            unknown.emplace_back(sigVec[i]);
+        }
+    }
+
+    if (not unknown.empty()) {
+        analyzer.recognizeObjects(unknown, objectVec, flags);
+    }
+
+    classified = unknown.size();
+
+    known = components;
+    knownSignals = sigVec;
+    knownTypes.clear();
+    for (const auto & object : objectVec) {
+        knownTypes.emplace_back(object.type);
+    }
+
+    return objectVec;
+}
+
+template <typename Analyzer>
+const std::vector<signals::ObjectSignals> & VideoAnalyzer<Analyzer>::signals() const {
+    return knownSignals;
+}
+
+template <typename Analyzer>
+size_t VideoAnalyzer<Analyzer>::dirtyTiles() const {
+    return labeler.dirtyTiles();
+}
+
+template <typename Analyzer>
+size_t VideoAnalyzer<Analyzer>::classifiedObjects() const {
+    return classified;
+}
+
+template <typename Analyzer>
+void VideoAnalyzer<Analyzer>::reset() {
+    labeler.reset();
+    known.clear();
+    knownSignals.clear();
+    knownTypes.clear();
+    classified = 0;
+}
+
+#endif
@@ -0,0 +1,80 @@
+#include "batch.hpp"
+
+#include <cctype>
+#include <filesystem>
+#include <sstream>
+
+
+/* Formats SFML is able to decode, and the binary PGM and PPM files read by ScanlineReader */
+static bool isImage(const std::filesystem::path & path) {
+    static const std::vector<std::string> extensions {
+        ".bmp", ".png", ".tga", ".jpg", ".jpeg", ".gif", ".psd", ".hdr", ".pic", ".pgm", ".ppm", ".pnm"
+    };
+
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](const unsigned char c) { return std::tolower(c); });
+
+    return std::find(extensions.begin(), extensions.end(), ext) != extensions.end();
+}
+
+
+std::vector<std::string> batch::collectImages(const std::vector<std::string> & paths) {
+    std::vector<std::string> images;
+
+    for (const auto & path : paths) {
+        if (not std::filesystem::is_directory(path)) {
+            images.emplace_back(path);
+            continue;
+        }
+
+        std::vector<std::string> found;
+
+        for (const auto & entry : std::filesystem::directory_iterator(path)) {
+            if (entry.is_regular_file() and isImage(entry.path())) {
+                found.emplace_back(entry.path().string());
+            }
+        }
+
+        std::sort(found.begin(), found.end());
+        images.insert(images.end(), found.begin(), found.end());
+    }
+
+    return images;
+}
+
+std::string batch::formatResult(const std::string & path, const std::vector<Object> & objects) {
+    std::ostringstream line;
+    line << path << '\t' << objects.size();
+
+    for (const auto & obj : objects) {
+        const auto & b = obj.bounds;
+        line << '\t' << obj.id << ':' << std::int64_t(obj.type == Object::noType ? -1 : obj.type) << ':'
+             << b.leftTop.x << ',' << b.leftTop.y << ',' << b.rightBottom.x << ',' << b.rightBottom.y;
+    }
+
+    return line.str();
+}
+
+std::string batch::formatError(const std::string & path, const std::string & message) {
+    return path + "\terror\t" + message;
+}
+
+
+batch::ResultWriter::ResultWriter(std::ostream & out, const bool ordered) : out(out), ordered(ordered) { }
+
+void batch::ResultWriter::write(const size_t idx, std::string line) {
+    std::lock_guard lock(mtx);
+
+    if (not ordered) {
+        out << line << '\n' << std::flush;
+        return;
+    }
+
+    pending.emplace(idx, std::move(line));
+
+    for (auto iter = pending.begin(); iter != pending.end() and iter->first == next; iter = pending.erase(iter), ++next) {
+        out << iter->second << '\n';
+    }
+
+    out << std::flush;
+}
@@ -1,49 +1,65 @@
 #include "filters.hpp"
 
-#include <unordered_set>
+#include <algorithm>
+#include <numeric>
 
 #include "signals.hpp"
 
 
-static void reindex(Image & img) {
+/* Maps the indices of objects to be kept onto consecutive indices in the order in */
+/* which the objects are first encountered when the image is scanned column after  */
+/* column, removed objects are mapped onto Pixel::noIndex                          */
+static std::vector<std::uint32_t> reindex(const std::vector<signals::Accumulator> & acc, const int threshold) {
 
-    std::uint32_t idx = 0;
-    std::unordered_map<std::uint32_t, std::uint32_t> indexMap;
+    std::vector<std::uint32_t> kept;
 
-    for (uint64_t x = 0; x < img.width(); ++x) {
-        for (uint64_t y = 0; y < img.height(); ++y) {
-            auto & pixel = img.at(x, y);
+    for (std::uint32_t idx = 0; idx < acc.size(); ++idx) {
+        if (acc[idx].area and acc[idx].perimeter >= std::uint64_t(std::max(threshold, 0))) {
+            kept.emplace_back(idx);
+        }
+    }
 
-            if (pixel.isIndexed()) {
-                if (not indexMap.count(pixel.index)) {
-                    indexMap[pixel.index] = idx++;
-                }
+    std::sort(kept.begin(), kept.end(), [&](const auto i1, const auto i2) {
+        return acc[i1].first < acc[i2].first;
+    });
 
-                pixel.index = indexMap[pixel.index];
-            }
-        }
+    std::vector<std::uint32_t> indexMap(acc.size(), Pixel::noIndex);
+
+    for (std::uint32_t i = 0; i < kept.size(); ++i) {
+        indexMap[kept[i]] = i;
     }
+
+    return indexMap;
 }
 
 
 Image filterBySize(const Image & input, const int threshold) {
+    return filterBySize(input, threshold, ThreadPool::sequential());
+}
+
+Image filterBySize(const Image & input, const int threshold, ThreadPool & pool) {
 
     Image dest(input);
 
-    const auto perimeters = signals::getPerimeters(input);
+    const auto indexMap = reindex(signals::accumulate(input, pool), threshold);
 
-    for (uint64_t x = 0; x < dest.width(); ++x) {
-        for (uint64_t y = 0; y < dest.height(); ++y) {
-            auto & pixel = dest.at(x, y);
-            if (pixel.isIndexed() and perimeters.at(pixel.index) < threshold) {
-                pixel.index = Pixel::noIndex;
-                pixel.color = 0;
+    pool.parallelFor(0, dest.height(), 16, [&](const size_t begin, const size_t end) {
+        for (uint32_t y = begin; y < end; ++y) {
+            for (uint32_t x = 0; x < dest.width(); ++x) {
+                auto & pixel = dest.at(x, y);
+
+                if (not pixel.isIndexed()) {
+                    continue;
+                }
+
+                pixel.index = indexMap[pixel.index];
+
+                if (not pixel.isIndexed()) {
+                    pixel.color = 0;
+                }
             }
         }
-    }
-
-    reindex(dest);
+    });
 
     return dest;
 }
-
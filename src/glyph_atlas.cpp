@@ -0,0 +1,245 @@
+#include "glyph_atlas.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_GLYPH_H
+#include FT_STROKER_H
+
+
+/* Owns the FreeType objects needed while the atlas is being built */
+struct FreeType {
+    FT_Library library = nullptr;
+    FT_Face face = nullptr;
+    FT_Stroker stroker = nullptr;
+
+    ~FreeType() {
+        if (stroker) {
+            FT_Stroker_Done(stroker);
+        }
+        if (face) {
+            FT_Done_Face(face);
+        }
+        if (library) {
+            FT_Done_FreeType(library);
+        }
+    }
+};
+
+struct Bitmap {
+    int32_t left = 0;
+    int32_t top = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> coverage;
+};
+
+
+/* Renders the glyph loaded in the face, stroked when a stroker is given */
+static Bitmap render(const FT_Face face, const FT_Stroker stroker) {
+    FT_Glyph glyph;
+    if (FT_Get_Glyph(face->glyph, &glyph)) {
+        throw std::runtime_error("Glyph could not be copied");
+    }
+
+    if ((stroker and FT_Glyph_Stroke(&glyph, stroker, 1)) or FT_Glyph_To_Bitmap(&glyph, FT_RENDER_MODE_NORMAL, nullptr, 1)) {
+        FT_Done_Glyph(glyph);
+        throw std::runtime_error("Glyph could not be rendered");
+    }
+
+    const auto bitmapGlyph = reinterpret_cast<FT_BitmapGlyph>(glyph);
+    const auto & bitmap = bitmapGlyph->bitmap;
+
+    Bitmap result;
+    result.left = bitmapGlyph->left;
+    result.top = bitmapGlyph->top;
+    result.width = bitmap.width;
+    result.height = bitmap.rows;
+    result.coverage.resize(size_t(bitmap.width) * bitmap.rows);
+
+    for (uint32_t y = 0; y < bitmap.rows; ++y) {
+        std::copy_n(bitmap.buffer + std::ptrdiff_t(y) * bitmap.pitch, bitmap.width, result.coverage.begin() + size_t(y) * bitmap.width);
+    }
+
+    FT_Done_Glyph(glyph);
+
+    return result;
+}
+
+static uint8_t blend(const uint32_t src, const uint32_t dst, const uint32_t alpha) {
+    return (src * alpha + dst * (255 - alpha) + 127) / 255;
+}
+
+static void blendPixel(uint8_t * px, const sf::Color color, const uint32_t coverage) {
+    const uint32_t alpha = (coverage * color.a + 127) / 255;
+
+    if (not alpha) {
+        return;
+    }
+
+    px[0] = blend(color.r, px[0], alpha);
+    px[1] = blend(color.g, px[1], alpha);
+    px[2] = blend(color.b, px[2], alpha);
+    px[3] = alpha + (px[3] * (255 - alpha) + 127) / 255;
+}
+
+
+GlyphAtlas::GlyphAtlas(const std::string & fontFile, const uint32_t size, const uint32_t outline, const std::string & characters) {
+
+    FreeType ft;
+
+    if (FT_Init_FreeType(&ft.library)) {
+        throw std::runtime_error("FreeType could not be initialized");
+    }
+
+    if (FT_New_Face(ft.library, fontFile.c_str(), 0, &ft.face)) {
+        throw std::runtime_error("Font could not be loaded.");
+    }
+
+    if (FT_Set_Pixel_Sizes(ft.face, 0, size)) {
+        throw std::runtime_error("Font size is not available");
+    }
+
+    if (outline) {
+        if (FT_Stroker_New(ft.library, &ft.stroker)) {
+            throw std::runtime_error("Outline could not be created");
+        }
+        FT_Stroker_Set(ft.stroker, FT_Fixed(outline) << 6, FT_STROKER_LINECAP_ROUND, FT_STROKER_LINEJOIN_ROUND, 0);
+    }
+
+    struct Rendered {
+        unsigned char character;
+        Bitmap fill;
+        Bitmap stroke;
+    };
+
+    std::vector<Rendered> rendered;
+
+    for (const unsigned char c : characters) {
+        if (c >= glyphs.size() or glyphs[c].present) {
+            continue;
+        }
+
+        if (FT_Load_Char(ft.face, c, FT_LOAD_DEFAULT)) {
+            throw std::runtime_error("Character could not be loaded");
+        }
+
+        auto & glyph = glyphs[c];
+        glyph.present = true;
+        glyph.advance = ft.face->glyph->advance.x >> 6;
+
+        auto fill = render(ft.face, nullptr);
+        auto stroke = ft.stroker ? render(ft.face, ft.stroker) : fill;
+
+        // The cell covers both the fill and the outline
+        glyph.left = std::min(fill.left, stroke.left);
+        glyph.top = std::max(fill.top, stroke.top);
+        glyph.width = std::max(fill.left + int32_t(fill.width), stroke.left + int32_t(stroke.width)) - glyph.left;
+        glyph.height = glyph.top - std::min(fill.top - int32_t(fill.height), stroke.top - int32_t(stroke.height));
+        glyph.x = atlasWidth;
+
+        atlasWidth += glyph.width;
+        atlasHeight = std::max(atlasHeight, glyph.height);
+
+        rendered.push_back({ c, std::move(fill), std::move(stroke) });
+    }
+
+    fillCoverage.assign(size_t(atlasWidth) * atlasHeight, 0);
+    outlineCoverage.assign(size_t(atlasWidth) * atlasHeight, 0);
+
+    const auto place = [&](const Glyph & glyph, const Bitmap & bitmap, std::vector<uint8_t> & coverage) {
+        const uint32_t offsetX = glyph.x + (bitmap.left - glyph.left);
+        const uint32_t offsetY = glyph.top - bitmap.top;
+
+        for (uint32_t y = 0; y < bitmap.height; ++y) {
+            for (uint32_t x = 0; x < bitmap.width; ++x) {
+                coverage[size_t(offsetY + y) * atlasWidth + offsetX + x] = bitmap.coverage[size_t(y) * bitmap.width + x];
+            }
+        }
+    };
+
+    for (const auto & r : rendered) {
+        place(glyphs[r.character], r.fill, fillCoverage);
+        place(glyphs[r.character], r.stroke, outlineCoverage);
+    }
+}
+
+GlyphAtlas::Bounds GlyphAtlas::measure(const std::string & text) const {
+    Bounds bounds {
+        std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::max(),
+        std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::min()
+    };
+
+    int32_t pen = 0;
+
+    for (const unsigned char c : text) {
+        if (c >= glyphs.size() or not glyphs[c].present) {
+            continue;
+        }
+
+        const auto & glyph = glyphs[c];
+        bounds.left = std::min(bounds.left, pen + glyph.left);
+        bounds.right = std::max(bounds.right, pen + glyph.left + int32_t(glyph.width));
+        bounds.top = std::min(bounds.top, -glyph.top);
+        bounds.bottom = std::max(bounds.bottom, -glyph.top + int32_t(glyph.height));
+        pen += glyph.advance;
+    }
+
+    return bounds;
+}
+
+void GlyphAtlas::draw(
+        uint8_t * pixels, const uint32_t width, const uint32_t height,
+        const std::string & text, const float x, const float y,
+        const sf::Color fill, const sf::Color outline,
+        const uint32_t firstRow, const uint32_t lastRow
+    ) const {
+
+    const auto bounds = measure(text);
+    if (bounds.left > bounds.right) {
+        return;
+    }
+
+    // Pen position of the first character which centers the ink of the text on (x, y)
+    int32_t penX = std::lround(x - (bounds.left + bounds.right) / 2.f);
+    const int32_t baseline = std::lround(y - (bounds.top + bounds.bottom) / 2.f);
+
+    const int32_t rowBegin = firstRow;
+    const int32_t rowEnd = std::min(height, lastRow);
+
+    for (const unsigned char c : text) {
+        if (c >= glyphs.size() or not glyphs[c].present) {
+            continue;
+        }
+
+        const auto & glyph = glyphs[c];
+        const int32_t cellX = penX + glyph.left;
+        const int32_t cellY = baseline - glyph.top;
+        penX += glyph.advance;
+
+        const int32_t top = std::max(rowBegin, cellY);
+        const int32_t bottom = std::min(rowEnd, cellY + int32_t(glyph.height));
+        const int32_t left = std::max(0, cellX);
+        const int32_t right = std::min<int32_t>(width, cellX + int32_t(glyph.width));
+
+        for (int32_t py = top; py < bottom; ++py) {
+            const size_t atlasRow = size_t(py - cellY) * atlasWidth + glyph.x;
+            uint8_t * row = pixels + size_t(py) * width * 4;
+
+            // The outline is drawn below the fill, as SFML does
+            for (int32_t px = left; px < right; ++px) {
+                const size_t cell = atlasRow + (px - cellX);
+                blendPixel(row + px * 4, outline, outlineCoverage[cell]);
+                blendPixel(row + px * 4, fill, fillCoverage[cell]);
+            }
+        }
+    }
+}
+
+void GlyphAtlas::draw(uint8_t * pixels, const uint32_t width, const uint32_t height, const std::string & text, const float x, const float y, const sf::Color fill, const sf::Color outline) const {
+    draw(pixels, width, height, text, x, y, fill, outline, 0, height);
+}
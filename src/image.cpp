@@ -6,6 +6,7 @@
 #include <functional>
 #include <stdexcept>
 #include <iostream>
+#include <cstring>
 
 #include <SFML/System.hpp>
 
@@ -90,19 +91,69 @@ static std::ostream & operator<<(std::ostream & os, const sf::Color color) {
 }
 
 sf::Image Image::reconstruct(const std::vector<sf::Color> & colors) const {
+    return reconstruct(colors, ThreadPool::sequential());
+}
+
+sf::Image Image::reconstruct(const std::vector<sf::Color> & colors, ThreadPool & pool) const {
+    std::vector<std::uint8_t> rgba(size_t(width()) * height() * 4);
+    reconstruct(colors, rgba.data(), pool);
+
     sf::Image img;
-    img.create(width(), height(), sf::Color::Black);
+    img.create(width(), height(), rgba.data());
+
+    return img;
+}
+
+static std::uint32_t pack(const sf::Color color) {
+    const std::uint8_t bytes[4] = { color.r, color.g, color.b, color.a };
+
+    std::uint32_t packed;
+    std::memcpy(&packed, bytes, sizeof(packed));
+
+    return packed;
+}
+
+std::vector<std::uint32_t> Image::palette(const std::vector<sf::Color> & colors, ThreadPool & pool) const {
 
-    for (uint32_t y = 0; y < height(); ++y) {
-        for (uint32_t x = 0; x < width(); ++x) {
-            auto & px = at(x, y);
+    // Highest index of every band of rows
+    const size_t bands = std::max<size_t>(1, std::min<size_t>(height(), 4 * pool.size()));
+    std::vector<std::uint32_t> highest(bands, 0);
 
-            if (px.isIndexed()) {
-                img.setPixel(x, y, colors[px.index % colors.size()]);
+    pool.run(bands, [&](const size_t band) {
+        for (uint32_t y = band * height() / bands; y < (band + 1) * height() / bands; ++y) {
+            for (const auto & px : img[y]) {
+                if (px.isIndexed()) {
+                    highest[band] = std::max(highest[band], px.index + 1);
+                }
             }
         }
+    });
+
+    std::vector<std::uint32_t> lut(*std::max_element(highest.begin(), highest.end()) + 1);
+    lut[0] = pack(sf::Color::Black);
+
+    for (size_t i = 1; i < lut.size(); ++i) {
+        lut[i] = pack(colors[(i - 1) % colors.size()]);
     }
 
-    return img;
+    return lut;
+}
+
+void Image::reconstructRows(const std::vector<std::uint32_t> & palette, std::uint8_t * rgba, const uint32_t begin, const uint32_t end) const {
+    for (uint32_t y = begin; y < end; ++y) {
+        const auto & row = img[y];
+        std::uint8_t * dest = rgba + size_t(y) * row.size() * 4;
+
+        for (size_t x = 0; x < row.size(); ++x) {
+            std::memcpy(dest + x * 4, &palette[std::uint32_t(row[x].index + 1)], 4);
+        }
+    }
 }
 
+void Image::reconstruct(const std::vector<sf::Color> & colors, std::uint8_t * rgba, ThreadPool & pool) const {
+    const auto lut = palette(colors, pool);
+
+    pool.parallelFor(0, height(), 16, [&](const size_t begin, const size_t end) {
+        reconstructRows(lut, rgba, begin, end);
+    });
+}
@@ -0,0 +1,60 @@
+#include "image_view.hpp"
+
+#include <stdexcept>
+
+
+uint32_t bytesPerPixel(const PixelFormat format) {
+    switch (format) {
+        case PixelFormat::gray8: return 1;
+        case PixelFormat::rgb24: return 3;
+        case PixelFormat::rgba32: return 4;
+        case PixelFormat::bgr24: return 3;
+        case PixelFormat::bgra32: return 4;
+    }
+
+    throw std::runtime_error("Unknown pixel format");
+}
+
+
+ImageView::ImageView(const uint8_t * data, const uint32_t width, const uint32_t height, const size_t stride, const PixelFormat format) :
+    pixels(data), w(width), h(height), rowStride(stride ? stride : size_t(width) * bytesPerPixel(format)), fmt(format) {
+
+    if (rowStride < size_t(width) * bytesPerPixel(format)) {
+        throw std::runtime_error("Stride is smaller than a row of pixels");
+    }
+
+    if (not data and width and height) {
+        throw std::runtime_error("Image view has no pixels");
+    }
+}
+
+ImageView::ImageView(const sf::Image & img) :
+    ImageView(img.getPixelsPtr(), img.getSize().x, img.getSize().y, 0, PixelFormat::rgba32) { }
+
+uint32_t ImageView::width() const {
+    return w;
+}
+
+uint32_t ImageView::height() const {
+    return h;
+}
+
+size_t ImageView::stride() const {
+    return rowStride;
+}
+
+PixelFormat ImageView::format() const {
+    return fmt;
+}
+
+const uint8_t * ImageView::row(const uint32_t y) const {
+    return pixels + y * rowStride;
+}
+
+ImageView ImageView::crop(const uint32_t x, const uint32_t y, const uint32_t width, const uint32_t height) const {
+    if (uint64_t(x) + width > w or uint64_t(y) + height > h) {
+        throw std::runtime_error("Cropped rectangle exceeds the image");
+    }
+
+    return ImageView(pixels + y * rowStride + size_t(x) * bytesPerPixel(fmt), width, height, rowStride, fmt);
+}
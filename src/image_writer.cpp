@@ -0,0 +1,617 @@
+#include "image_writer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+
+static void put16le(std::vector<uint8_t> & out, const uint32_t value) {
+    out.push_back(value & 0xFF);
+    out.push_back((value >> 8) & 0xFF);
+}
+
+static void put32le(std::vector<uint8_t> & out, const uint32_t value) {
+    put16le(out, value & 0xFFFF);
+    put16le(out, value >> 16);
+}
+
+static void put32be(std::vector<uint8_t> & out, const uint32_t value) {
+    out.push_back(value >> 24);
+    out.push_back((value >> 16) & 0xFF);
+    out.push_back((value >> 8) & 0xFF);
+    out.push_back(value & 0xFF);
+}
+
+
+static uint32_t crc32(const uint8_t * data, const size_t size) {
+    static const auto table = []() {
+        std::array<uint32_t, 256> t;
+
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            t[n] = c;
+        }
+
+        return t;
+    }();
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+
+    return crc ^ 0xFFFFFFFFu;
+}
+
+/* Chunks hold at most 2^31 - 1 bytes, larger data is split into consecutive chunks of the same type */
+static void pngChunk(std::vector<uint8_t> & out, const char * type, const uint8_t * data, const size_t size) {
+    constexpr size_t maxChunk = 0x7FFFFFFF;
+
+    size_t offset = 0;
+    do {
+        const size_t length = std::min(maxChunk, size - offset);
+        put32be(out, length);
+
+        const size_t start = out.size();
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data + offset, data + offset + length);
+
+        put32be(out, crc32(out.data() + start, out.size() - start));
+        offset += length;
+    } while (offset < size);
+}
+
+static uint32_t adler32(const std::vector<uint8_t> & data) {
+    uint32_t a = 1, b = 0;
+
+    for (const auto byte : data) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+
+    return (b << 16) | a;
+}
+
+
+/* Writes bits least significant first, the order of deflate streams */
+struct BitWriter {
+    std::vector<uint8_t> & out;
+    uint64_t bits = 0;
+    uint32_t count = 0;
+
+    void put(const uint32_t value, const uint32_t length) {
+        bits |= uint64_t(value) << count;
+        count += length;
+
+        while (count >= 8) {
+            out.push_back(bits & 0xFF);
+            bits >>= 8;
+            count -= 8;
+        }
+    }
+
+    /* Huffman codes are stored most significant bit first */
+    void putCode(const uint32_t code, const uint32_t length) {
+        uint32_t reversed = 0;
+        for (uint32_t i = 0; i < length; ++i) {
+            reversed |= ((code >> i) & 1) << (length - 1 - i);
+        }
+
+        put(reversed, length);
+    }
+
+    void flush() {
+        if (count) {
+            out.push_back(bits & 0xFF);
+            bits = 0;
+            count = 0;
+        }
+    }
+};
+
+static constexpr uint16_t lengthBase[] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static constexpr uint8_t lengthExtra[] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static constexpr uint16_t distanceBase[] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static constexpr uint8_t distanceExtra[] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+/* Symbols of the literal/length alphabet in the fixed Huffman code of deflate */
+static void putSymbol(BitWriter & bits, const uint32_t symbol) {
+    if (symbol < 144) {
+        bits.putCode(0x30 + symbol, 8);
+    } else if (symbol < 256) {
+        bits.putCode(0x190 + symbol - 144, 9);
+    } else if (symbol < 280) {
+        bits.putCode(symbol - 256, 7);
+    } else {
+        bits.putCode(0xC0 + symbol - 280, 8);
+    }
+}
+
+static void putMatch(BitWriter & bits, const uint32_t length, const uint32_t distance) {
+    uint32_t l = 28;
+    while (lengthBase[l] > length) {
+        --l;
+    }
+    putSymbol(bits, 257 + l);
+    bits.put(length - lengthBase[l], lengthExtra[l]);
+
+    uint32_t d = 29;
+    while (distanceBase[d] > distance) {
+        --d;
+    }
+    bits.putCode(d, 5);
+    bits.put(distance - distanceBase[d], distanceExtra[d]);
+}
+
+/* A single block of fixed Huffman codes over greedy LZ77 matches found through hash chains. */
+/* Filtered rows of segmented images are mostly long runs, which this compresses well.       */
+static void deflate(const std::vector<uint8_t> & data, std::vector<uint8_t> & out) {
+
+    constexpr size_t window = 32768;
+    constexpr size_t maxLength = 258;
+    constexpr size_t maxChain = 32;
+    constexpr uint32_t hashBits = 15;
+    constexpr size_t none = ~size_t(0);
+
+    std::vector<size_t> head(size_t(1) << hashBits, none);
+    std::vector<size_t> previous(window, none);
+
+    const size_t size = data.size();
+
+    const auto hash = [&](const size_t pos) {
+        const uint32_t bytes = data[pos] | data[pos + 1] << 8 | data[pos + 2] << 16;
+        return (bytes * 2654435761u) >> (32 - hashBits);
+    };
+
+    const auto insert = [&](const size_t pos) {
+        if (pos + 3 <= size) {
+            const auto h = hash(pos);
+            previous[pos % window] = head[h];
+            head[h] = pos;
+        }
+    };
+
+    BitWriter bits { out };
+    bits.put(1, 1);
+    bits.put(1, 2);
+
+    for (size_t pos = 0; pos < size;) {
+        size_t best = 0, distance = 0;
+
+        if (pos + 3 <= size) {
+            const size_t limit = std::min(maxLength, size - pos);
+            size_t candidate = head[hash(pos)];
+
+            // Positions of the chain lie within the window, so their slots were not reused yet
+            for (size_t chain = 0; candidate != none and pos - candidate < window and chain < maxChain; ++chain) {
+                size_t length = 0;
+                while (length < limit and data[candidate + length] == data[pos + length]) {
+                    ++length;
+                }
+
+                if (length > best) {
+                    best = length;
+                    distance = pos - candidate;
+
+                    if (length == limit) {
+                        break;
+                    }
+                }
+
+                candidate = previous[candidate % window];
+            }
+        }
+
+        if (best >= 3) {
+            putMatch(bits, best, distance);
+
+            for (size_t i = 0; i < best; ++i) {
+                insert(pos + i);
+            }
+            pos += best;
+        } else {
+            putSymbol(bits, data[pos]);
+            insert(pos);
+            ++pos;
+        }
+    }
+
+    putSymbol(bits, 256);
+    bits.flush();
+}
+
+/* Stored blocks merely copy the data */
+static void store(const std::vector<uint8_t> & data, std::vector<uint8_t> & out) {
+    out.reserve(out.size() + data.size() + data.size() / 65535 * 5 + 16);
+
+    size_t offset = 0;
+    do {
+        const size_t length = std::min<size_t>(65535, data.size() - offset);
+
+        out.push_back(offset + length == data.size());
+        put16le(out, length);
+        put16le(out, ~length & 0xFFFF);
+        out.insert(out.end(), data.begin() + offset, data.begin() + offset + length);
+
+        offset += length;
+    } while (offset < data.size());
+}
+
+static uint8_t paeth(const int a, const int b, const int c) {
+    const int p = a + b - c;
+    const int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+
+    return (pa <= pb and pa <= pc) ? a : (pb <= pc ? b : c);
+}
+
+/* Every row is filtered by the filter with the smallest sum of absolute differences, or */
+/* by none when stored, and the zlib stream is compressed or consists of stored blocks   */
+static std::vector<uint8_t> encodePng(const uint8_t * rgba, const uint32_t width, const uint32_t height, const bool compressed) {
+
+    const size_t rowSize = size_t(width) * 4;
+
+    std::vector<uint8_t> raw;
+    raw.reserve((rowSize + 1) * height);
+
+    std::array<std::vector<uint8_t>, 5> filtered;
+    for (auto & row : filtered) {
+        row.resize(rowSize);
+    }
+
+    for (uint32_t y = 0; y < height; ++y) {
+        const uint8_t * row = rgba + y * rowSize;
+
+        if (not compressed) {
+            raw.push_back(0);
+            raw.insert(raw.end(), row, row + rowSize);
+            continue;
+        }
+
+        const uint8_t * up = y ? row - rowSize : nullptr;
+        size_t bestFilter = 0, bestCost = ~size_t(0);
+
+        for (size_t filter = 0; filter < filtered.size(); ++filter) {
+            size_t cost = 0;
+
+            for (size_t i = 0; i < rowSize; ++i) {
+                const int a = i >= 4 ? row[i - 4] : 0;
+                const int b = up ? up[i] : 0;
+                const int c = (up and i >= 4) ? up[i - 4] : 0;
+
+                const int predicted = filter == 0 ? 0 : filter == 1 ? a : filter == 2 ? b : filter == 3 ? (a + b) / 2 : paeth(a, b, c);
+                const uint8_t value = row[i] - predicted;
+
+                filtered[filter][i] = value;
+                cost += value < 128 ? value : 256 - value;
+            }
+
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestFilter = filter;
+            }
+        }
+
+        raw.push_back(bestFilter);
+        raw.insert(raw.end(), filtered[bestFilter].begin(), filtered[bestFilter].end());
+    }
+
+    std::vector<uint8_t> zlib { 0x78, 0x01 };
+    if (compressed) {
+        deflate(raw, zlib);
+    } else {
+        store(raw, zlib);
+    }
+    put32be(zlib, adler32(raw));
+
+    std::vector<uint8_t> header;
+    put32be(header, width);
+    put32be(header, height);
+    header.insert(header.end(), { 8, 6, 0, 0, 0 });
+
+    std::vector<uint8_t> out { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    pngChunk(out, "IHDR", header.data(), header.size());
+    pngChunk(out, "IDAT", zlib.data(), zlib.size());
+    pngChunk(out, "IEND", nullptr, 0);
+
+    return out;
+}
+
+/* 24 bit bottom-up bitmap */
+static std::vector<uint8_t> encodeBmp(const uint8_t * rgba, const uint32_t width, const uint32_t height) {
+
+    const size_t stride = (size_t(width) * 3 + 3) & ~size_t(3);
+    const size_t imageSize = stride * height;
+
+    std::vector<uint8_t> out { 'B', 'M' };
+    out.reserve(54 + imageSize);
+
+    put32le(out, 54 + imageSize);
+    put32le(out, 0);
+    put32le(out, 54);
+
+    put32le(out, 40);
+    put32le(out, width);
+    put32le(out, height);
+    put16le(out, 1);
+    put16le(out, 24);
+    put32le(out, 0);
+    put32le(out, imageSize);
+    put32le(out, 2835);
+    put32le(out, 2835);
+    put32le(out, 0);
+    put32le(out, 0);
+
+    for (uint32_t y = height; y-- > 0;) {
+        const uint8_t * row = rgba + size_t(y) * width * 4;
+
+        for (uint32_t x = 0; x < width; ++x) {
+            out.insert(out.end(), { row[x*4 + 2], row[x*4 + 1], row[x*4] });
+        }
+        out.resize(out.size() + stride - size_t(width) * 3, 0);
+    }
+
+    return out;
+}
+
+static std::vector<uint8_t> encodePpm(const uint8_t * rgba, const uint32_t width, const uint32_t height) {
+
+    const std::string header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+
+    std::vector<uint8_t> out(header.begin(), header.end());
+    out.reserve(header.size() + size_t(width) * height * 3);
+
+    for (size_t i = 0; i < size_t(width) * height; ++i) {
+        out.insert(out.end(), rgba + i * 4, rgba + i * 4 + 3);
+    }
+
+    return out;
+}
+
+static std::vector<uint8_t> encodeQoi(const uint8_t * rgba, const uint32_t width, const uint32_t height) {
+
+    struct Rgba {
+        uint8_t r, g, b, a;
+
+        bool operator==(const Rgba & o) const {
+            return r == o.r and g == o.g and b == o.b and a == o.a;
+        }
+    };
+
+    std::vector<uint8_t> out { 'q', 'o', 'i', 'f' };
+    put32be(out, width);
+    put32be(out, height);
+    out.push_back(4);
+    out.push_back(0);
+
+    std::array<Rgba, 64> seen { };
+    Rgba prev { 0, 0, 0, 255 };
+    uint32_t run = 0;
+
+    const size_t count = size_t(width) * height;
+
+    for (size_t i = 0; i < count; ++i) {
+        const Rgba px { rgba[i*4], rgba[i*4 + 1], rgba[i*4 + 2], rgba[i*4 + 3] };
+
+        if (px == prev) {
+            if (++run == 62 or i + 1 == count) {
+                out.push_back(0xC0 | (run - 1));
+                run = 0;
+            }
+            continue;
+        }
+
+        if (run) {
+            out.push_back(0xC0 | (run - 1));
+            run = 0;
+        }
+
+        const size_t hash = (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) % 64;
+
+        if (seen[hash] == px) {
+            out.push_back(hash);
+        } else {
+            seen[hash] = px;
+
+            if (px.a == prev.a) {
+                const int8_t dr = px.r - prev.r;
+                const int8_t dg = px.g - prev.g;
+                const int8_t db = px.b - prev.b;
+                const int8_t drg = dr - dg;
+                const int8_t dbg = db - dg;
+
+                if (dr > -3 and dr < 2 and dg > -3 and dg < 2 and db > -3 and db < 2) {
+                    out.push_back(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+                } else if (drg > -9 and drg < 8 and dg > -33 and dg < 32 and dbg > -9 and dbg < 8) {
+                    out.push_back(0x80 | (dg + 32));
+                    out.push_back((drg + 8) << 4 | (dbg + 8));
+                } else {
+                    out.insert(out.end(), { 0xFE, px.r, px.g, px.b });
+                }
+            } else {
+                out.insert(out.end(), { 0xFF, px.r, px.g, px.b, px.a });
+            }
+        }
+
+        prev = px;
+    }
+
+    out.insert(out.end(), { 0, 0, 0, 0, 0, 0, 0, 1 });
+
+    return out;
+}
+
+
+static std::string lowercase(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(), [](const unsigned char c) { return std::tolower(c); });
+    return text;
+}
+
+
+output::Format output::parseFormat(const std::string & name) {
+    const auto lower = lowercase(name);
+
+    if (lower == "png") {
+        return Format::png;
+    }
+    if (lower == "png-stored") {
+        return Format::storedPng;
+    }
+    if (lower == "bmp") {
+        return Format::bmp;
+    }
+    if (lower == "ppm") {
+        return Format::ppm;
+    }
+    if (lower == "qoi") {
+        return Format::qoi;
+    }
+
+    throw std::runtime_error("Unknown output format " + name);
+}
+
+output::Format output::formatOf(const std::string & filename) {
+    const auto dot = filename.find_last_of('.');
+
+    try {
+        return parseFormat(dot == std::string::npos ? "" : filename.substr(dot + 1));
+    } catch (const std::runtime_error &) {
+        return Format::png;
+    }
+}
+
+std::string output::withExtension(const std::string & filename, const Format format) {
+    static const char * extensions[] = { ".png", ".png", ".bmp", ".ppm", ".qoi" };
+
+    const auto dot = filename.find_last_of('.');
+    const auto slash = filename.find_last_of('/');
+    const bool hasExtension = dot != std::string::npos and (slash == std::string::npos or dot > slash);
+
+    return (hasExtension ? filename.substr(0, dot) : filename) + extensions[size_t(format)];
+}
+
+std::vector<uint8_t> output::encode(const Format format, const uint8_t * rgba, const uint32_t width, const uint32_t height) {
+    switch (format) {
+        case Format::png: return encodePng(rgba, width, height, true);
+        case Format::storedPng: return encodePng(rgba, width, height, false);
+        case Format::bmp: return encodeBmp(rgba, width, height);
+        case Format::ppm: return encodePpm(rgba, width, height);
+        case Format::qoi: return encodeQoi(rgba, width, height);
+    }
+
+    throw std::runtime_error("Unknown output format");
+}
+
+void output::write(const std::string & filename, const Format format, const uint8_t * rgba, const uint32_t width, const uint32_t height) {
+    const auto encoded = encode(format, rgba, width, height);
+
+    std::ofstream out(filename, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(encoded.data()), encoded.size());
+
+    if (not out) {
+        throw std::runtime_error("File " + filename + " could not be written");
+    }
+}
+
+
+ImageWriter::ImageWriter(const size_t capacity) : capacity(std::max<size_t>(1, capacity)) { }
+
+ImageWriter::~ImageWriter() {
+    {
+        std::unique_lock lock(mtx);
+        changed.wait(lock, [&]() { return jobs.empty() and not busy; });
+        stop = true;
+    }
+    changed.notify_all();
+
+    if (worker.joinable()) {
+        worker.join();
+    }
+
+    if (error) {
+        try {
+            std::rethrow_exception(error);
+        } catch (const std::exception & e) {
+            std::clog << e.what() << std::endl;
+        }
+    }
+}
+
+void ImageWriter::work() {
+    while (true) {
+        std::unique_lock lock(mtx);
+        changed.wait(lock, [&]() { return stop or not jobs.empty(); });
+
+        if (jobs.empty()) {
+            return;
+        }
+
+        Job job = std::move(jobs.front());
+        jobs.pop_front();
+        busy = true;
+        lock.unlock();
+        changed.notify_all();
+
+        std::exception_ptr failure;
+        try {
+            output::write(job.filename, job.format, job.rgba.data(), job.width, job.height);
+        } catch (...) {
+            failure = std::current_exception();
+        }
+
+        lock.lock();
+        busy = false;
+        if (failure and not error) {
+            error = failure;
+        }
+        lock.unlock();
+        changed.notify_all();
+    }
+}
+
+void ImageWriter::write(std::string filename, const output::Format format, std::vector<uint8_t> rgba, const uint32_t width, const uint32_t height) {
+
+    if (rgba.size() != size_t(width) * height * 4) {
+        throw std::runtime_error("Pixel buffer does not match the image size");
+    }
+
+    {
+        std::unique_lock lock(mtx);
+
+        // The thread is started by the first image, writers which never write cost nothing
+        if (not worker.joinable()) {
+            worker = std::thread(&ImageWriter::work, this);
+        }
+
+        changed.wait(lock, [&]() { return jobs.size() < capacity; });
+        jobs.push_back({ std::move(filename), format, std::move(rgba), width, height });
+    }
+    changed.notify_all();
+}
+
+void ImageWriter::flush() {
+    std::unique_lock lock(mtx);
+    changed.wait(lock, [&]() { return jobs.empty() and not busy; });
+
+    if (error) {
+        auto failure = error;
+        error = nullptr;
+        std::rethrow_exception(failure);
+    }
+}
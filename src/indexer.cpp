@@ -1,58 +1,143 @@
 #include "indexer.hpp"
 
-void Indexer::assignRecursively(const uint32_t x, const uint32_t y) {
+bool Indexer::isForeground(const uint32_t x, const uint32_t y) const {
+    return dest.at(x, y).color == Pixel::colorMax;
+}
 
-    auto & px = dest.at(x, y);
-    if (px.color != Pixel::colorMax or px.isIndexed()) {
-        return;
+uint32_t Indexer::find(uint32_t px) {
+    // Path halving, every visited pixel skips its parent
+    while (parent[px] != px) {
+        parent[px] = parent[parent[px]];
+        px = parent[px];
     }
 
-    px.index = idxCounter;
-
+    return px;
+}
 
-    if (x) {
-        assignRecursively(x-1, y);
-    }
-    if (x < dest.width()-1) {
-        assignRecursively(x+1, y);
-    }
-    if (y) {
-        assignRecursively(x, y-1);
-    }
-    if (y < dest.height()-1) {
-        assignRecursively(x, y+1);
+uint32_t Indexer::root(uint32_t px) const {
+    while (parent[px] != px) {
+        px = parent[px];
     }
 
+    return px;
 }
 
-void Indexer::assignIndex(const uint32_t x, const uint32_t y) {
+void Indexer::unite(const uint32_t px1, const uint32_t px2) {
+    const auto r1 = find(px1);
+    const auto r2 = find(px2);
 
-    auto & px = dest.at(x, y);
-    
-    if (px.color != Pixel::colorMax or px.isIndexed()) {
-        return;
+    if (r1 < r2) {
+        parent[r2] = r1;
+    } else if (r2 < r1) {
+        parent[r1] = r2;
     }
+}
 
-    assignRecursively(x, y);
+void Indexer::labelBand(const uint32_t begin, const uint32_t end) {
+    const uint32_t width = dest.width();
 
-    ++idxCounter;
-}
+    for (uint32_t y = begin; y < end; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            if (not isForeground(x, y)) {
+                continue;
+            }
 
-void Indexer::assignIndices() {
-    for (uint32_t y = 0; y < dest.height(); ++y) {
-        for (uint32_t x = 0; x < dest.width(); ++x) {
-            assignIndex(x, y);
+            const uint32_t px = y * width + x;
+            parent[px] = px;
+
+            if (x and isForeground(x-1, y)) {
+                unite(px - 1, px);
+            }
+            if (y > begin and isForeground(x, y-1)) {
+                unite(px - width, px);
+            }
         }
     }
 }
 
 Image Indexer::assignIndices(const Image & img) {
+    return assignIndices(img, ThreadPool::sequential());
+}
+
+Image Indexer::assignIndices(const Image & img, ThreadPool & pool) {
 
     dest = Image(img);
-    idxCounter = 0;
 
-    assignIndices();
+    if (not dest.height()) {
+        return dest;
+    }
+
+    const uint32_t width = dest.width();
+    const uint32_t height = dest.height();
+    parent.resize(size_t(width) * height);
+
+    const size_t bands = std::min<size_t>(height, 4 * pool.size());
+    const auto bandBegin = [&](const size_t band) -> uint32_t { return band * height / bands; };
+
+    // Components are labeled within each band first, bands only touch their own pixels
+    pool.run(bands, [&](const size_t band) {
+        labelBand(bandBegin(band), bandBegin(band + 1));
+    });
+
+    // Components crossing the boundary between two bands are joined
+    for (size_t band = 1; band < bands; ++band) {
+        const uint32_t y = bandBegin(band);
+
+        for (uint32_t x = 0; x < width; ++x) {
+            if (isForeground(x, y) and isForeground(x, y-1)) {
+                unite(y * width + x - width, y * width + x);
+            }
+        }
+    }
+
+    // Roots are numbered in row-major order, each band starts after the roots of the previous ones
+    std::vector<uint32_t> firstIndex(bands + 1, 0);
+
+    pool.run(bands, [&](const size_t band) {
+        uint32_t roots = 0;
+
+        for (uint32_t y = bandBegin(band); y < bandBegin(band + 1); ++y) {
+            for (uint32_t x = 0; x < width; ++x) {
+                roots += isForeground(x, y) and parent[y * width + x] == y * width + x;
+            }
+        }
+
+        firstIndex[band + 1] = roots;
+    });
+
+    for (size_t band = 0; band < bands; ++band) {
+        firstIndex[band + 1] += firstIndex[band];
+    }
+
+    pool.run(bands, [&](const size_t band) {
+        uint32_t idx = firstIndex[band];
+
+        for (uint32_t y = bandBegin(band); y < bandBegin(band + 1); ++y) {
+            for (uint32_t x = 0; x < width; ++x) {
+                if (isForeground(x, y) and parent[y * width + x] == y * width + x) {
+                    dest.at(x, y).index = idx++;
+                }
+            }
+        }
+    });
+
+    // The forest is no longer modified, every pixel takes the index of its root
+    pool.run(bands, [&](const size_t band) {
+        for (uint32_t y = bandBegin(band); y < bandBegin(band + 1); ++y) {
+            for (uint32_t x = 0; x < width; ++x) {
+                if (not isForeground(x, y)) {
+                    continue;
+                }
+
+                const uint32_t r = root(y * width + x);
+                if (r == y * width + x) {
+                    continue;
+                }
+
+                dest.at(x, y).index = dest.at(r % width, r / width).index;
+            }
+        }
+    });
 
     return dest;
 }
-
@@ -0,0 +1,212 @@
+#include "line_scanner.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+#include "pixel.hpp"
+
+
+/* Moves the sums of an object whose coordinates are relative to a lower top row onto */
+/* those relative to a top row which lies rows higher                                 */
+static void translate(signals::Accumulator & acc, const uint64_t rows) {
+    acc.sumXY += rows * acc.sumX;
+    acc.sumYY += 2 * rows * acc.sumY + rows * rows * acc.area;
+    acc.sumY += rows * acc.area;
+}
+
+
+void RowLabeler::Open::merge(const Open & other) {
+    auto sums = other.acc;
+
+    if (other.top > top) {
+        translate(sums, other.top - top);
+    } else {
+        translate(acc, top - other.top);
+        top = other.top;
+    }
+
+    acc.merge(sums);
+    left = std::min(left, other.left);
+    right = std::max(right, other.right);
+    bottom = std::max(bottom, other.bottom);
+}
+
+
+RowLabeler::RowLabeler(const uint32_t width, const uint8_t threshold, const int minPerimeter) :
+    width(width), threshold(threshold), minPerimeter(std::max(minPerimeter, 0)),
+    above(width, 0), current(width, 0), below(width, 0), labels(width, Pixel::noIndex) {
+
+    if (not width) {
+        throw std::runtime_error("Rows must be at least one pixel wide");
+    }
+}
+
+uint32_t RowLabeler::find(uint32_t object) {
+    while (parent[object] != object) {
+        parent[object] = parent[parent[object]];
+        object = parent[object];
+    }
+
+    return object;
+}
+
+void RowLabeler::unite(const uint32_t object1, const uint32_t object2) {
+    auto r1 = find(object1);
+    auto r2 = find(object2);
+
+    if (r1 == r2) {
+        return;
+    }
+
+    if (r2 < r1) {
+        std::swap(r1, r2);
+    }
+
+    objects[r1].merge(objects[r2]);
+    parent[r2] = r1;
+}
+
+void RowLabeler::advance(const Sink & sink) {
+
+    // The row below joins the objects it touches and opens new ones
+    std::vector<uint32_t> next(width, Pixel::noIndex);
+
+    for (uint32_t x = 0; x < width; ++x) {
+        if (not below[x]) {
+            continue;
+        }
+
+        if (x and below[x-1]) {
+            next[x] = next[x-1];
+        }
+
+        if (current[x]) {
+            if (next[x] == Pixel::noIndex) {
+                next[x] = labels[x];
+            } else {
+                unite(next[x], labels[x]);
+            }
+        }
+
+        if (next[x] == Pixel::noIndex) {
+            next[x] = objects.size();
+            objects.push_back({ { }, rows, x, x, rows });
+            parent.emplace_back(next[x]);
+        }
+    }
+
+    // Now that its neighbours below are known, the pixels of the current row are added
+    const uint64_t y = rows - 1;
+
+    for (uint32_t x = 0; x < width; ++x) {
+        if (not current[x]) {
+            continue;
+        }
+
+        auto & object = objects[find(labels[x])];
+
+        const bool boundary = not x or not current[x-1] or x + 1 == width or not current[x+1] or not above[x] or not below[x];
+
+        // Coordinates are relative to the top row of the object, which keeps the sums small on endless streams
+        object.acc.addPixel(x, y - object.top, 0, boundary);
+        object.left = std::min(object.left, x);
+        object.right = std::max(object.right, x);
+        object.bottom = std::max(object.bottom, y);
+    }
+
+    // Objects of the current row which the row below does not touch are complete
+    enum : uint8_t { closed, open, reported };
+    std::vector<uint8_t> state(objects.size(), closed);
+
+    for (uint32_t x = 0; x < width; ++x) {
+        if (next[x] != Pixel::noIndex) {
+            state[find(next[x])] = open;
+        }
+    }
+
+    for (uint32_t x = 0; x < width; ++x) {
+        if (labels[x] == Pixel::noIndex) {
+            continue;
+        }
+
+        const auto root = find(labels[x]);
+
+        if (state[root] == closed) {
+            const auto & object = objects[root];
+
+            if (object.acc.perimeter >= uint64_t(minPerimeter)) {
+                // An object starts within the first epochRows rows of its epoch, only one taller
+                // than 2^32 - epochRows rows can not be bounded
+                const uint64_t epoch = object.top - object.top % epochRows;
+
+                if (object.bottom - epoch > UINT32_MAX) {
+                    throw std::runtime_error("Object spans more rows than its bounds can hold");
+                }
+
+                const Bounds bounds { { object.left, uint32_t(object.top - epoch) }, { object.right, uint32_t(object.bottom - epoch) } };
+                sink({ object.acc, bounds, epoch });
+            }
+
+            state[root] = reported;
+        }
+    }
+
+    // Only the objects of the row below are kept, renumbered from zero
+    std::vector<Open> kept;
+    std::vector<uint32_t> renumbered(objects.size(), Pixel::noIndex);
+
+    for (uint32_t x = 0; x < width; ++x) {
+        if (next[x] == Pixel::noIndex) {
+            continue;
+        }
+
+        const auto root = find(next[x]);
+
+        if (renumbered[root] == Pixel::noIndex) {
+            renumbered[root] = kept.size();
+            kept.emplace_back(objects[root]);
+        }
+
+        next[x] = renumbered[root];
+    }
+
+    objects = std::move(kept);
+    parent.resize(objects.size());
+    for (uint32_t i = 0; i < parent.size(); ++i) {
+        parent[i] = i;
+    }
+
+    labels = std::move(next);
+
+    std::swap(above, current);
+    std::swap(current, below);
+}
+
+void RowLabeler::push(const ImageView & view, const Sink & sink) {
+    if (view.width() != width) {
+        throw std::runtime_error("Rows must be as wide as the stream");
+    }
+
+    for (uint32_t y = 0; y < view.height(); ++y) {
+        view.scanRow(y, [&](const uint32_t x, const uint8_t current) {
+            below[x] = current > threshold;
+        });
+
+        advance(sink);
+        ++rows;
+    }
+}
+
+void RowLabeler::finish(const Sink & sink) {
+    // A row of background closes every object
+    std::fill(below.begin(), below.end(), 0);
+    advance(sink);
+
+    std::fill(above.begin(), above.end(), 0);
+    std::fill(current.begin(), current.end(), 0);
+    std::fill(labels.begin(), labels.end(), Pixel::noIndex);
+    objects.clear();
+    parent.clear();
+    rows = 0;
+}
@@ -1,5 +1,6 @@
 #include <SFML/Graphics.hpp>
 #include <iostream>
+#include <fstream>
 #include <vector>
 
 #include "image.hpp"
@@ -9,8 +10,130 @@
 #include "kmeans.hpp"
 #include "filters.hpp"
 #include "image_analyzer.hpp"
+#include "batch.hpp"
 
-void run() {
+
+struct Arguments {
+    std::string modelFile = "model.bin";
+    std::string trainFile = "resources/train/train.bmp";
+    bool forceTraining = false;
+    size_t threads = 0;
+    bool pinned = false;
+    bool mapped = false;
+    std::string cacheDirectory;
+    uint64_t cacheMegabytes = 1024;
+    bool cacheImages = false;
+    std::string outputFile;
+    output::Formats formats;
+    batch::Options batch;
+    std::vector<std::string> paths;
+    bool help = false;
+};
+
+static const char * usage =
+    "Usage: image-analysis [options] [image or directory...]\n"
+    "\n"
+    "  -m, --model FILE    model to load, or to save after training (default model.bin)\n"
+    "  -t, --train FILE    train on FILE even if the model exists\n"
+    "  -j, --threads N     threads of the shared thread pool (default all cores)\n"
+    "      --pin           pin the threads of the pool to cores\n"
+    "      --mmap          memory map uncompressed BMP, PGM and PPM images instead of reading them\n"
+    "      --cache DIR     reuse results of images recognized before with the same model, kept in DIR\n"
+    "      --cache-size MB most megabytes of results kept in the cache directory (default 1024)\n"
+    "      --cache-images  cache the written images too, so that hits need not recognize again\n"
+    "  -o, --output FILE   write results to FILE instead of the standard output\n"
+    "  -u, --unordered     write results as soon as images are done instead of in input order\n"
+    "  -p, --pipeline      run the stages of recognition on dedicated threads, results are ordered\n"
+    "  -q, --quantized     classify using the int8 network\n"
+    "      --tile N        recognize images in tiles of N x N pixels, for images too large for memory\n"
+    "      --coarse N      label only regions of N x N cells holding foreground, for sparse images\n"
+    "  -f, --format FMT    format of the written images - png, png-stored, bmp, ppm or qoi (default png)\n"
+    "      --reconstruction-format FMT, --annotation-format FMT\n"
+    "                      format of the reconstructed or the annotated images only\n"
+    "  -h, --help          show this help\n"
+    "\n"
+    "Every image is written as a single tab separated line - path, number of objects and\n"
+    "id:type:left,top,right,bottom of every object. Without images, the test image is\n"
+    "recognized and the annotated images are written to the working directory.\n";
+
+
+static Arguments parseArguments(const int argc, const char * argv[]) {
+    Arguments args;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+
+        const auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::runtime_error("Missing value of " + arg);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "-m" or arg == "--model") {
+            args.modelFile = value();
+        } else if (arg == "-t" or arg == "--train") {
+            args.trainFile = value();
+            args.forceTraining = true;
+        } else if (arg == "-j" or arg == "--threads") {
+            args.threads = std::stoul(value());
+        } else if (arg == "--pin") {
+            args.pinned = true;
+        } else if (arg == "--mmap") {
+            args.mapped = true;
+        } else if (arg == "--cache") {
+            args.cacheDirectory = value();
+        } else if (arg == "--cache-size") {
+            args.cacheMegabytes = std::stoull(value());
+        } else if (arg == "--cache-images") {
+            args.cacheImages = true;
+        } else if (arg == "-o" or arg == "--output") {
+            args.outputFile = value();
+        } else if (arg == "-u" or arg == "--unordered") {
+            args.batch.ordered = false;
+        } else if (arg == "-p" or arg == "--pipeline") {
+            args.batch.pipelined = true;
+        } else if (arg == "--tile") {
+            args.batch.tileSize = std::stoul(value());
+        } else if (arg == "--coarse") {
+            args.batch.coarseFactor = std::stoul(value());
+        } else if (arg == "-q" or arg == "--quantized") {
+            args.batch.flags |= ImageAnalyzer<3, ConstantThreshold<35>>::Flags::quantized;
+        } else if (arg == "-f" or arg == "--format") {
+            args.formats.reconstruction = args.formats.annotation = output::parseFormat(value());
+        } else if (arg == "--reconstruction-format") {
+            args.formats.reconstruction = output::parseFormat(value());
+        } else if (arg == "--annotation-format") {
+            args.formats.annotation = output::parseFormat(value());
+        } else if (arg == "-h" or arg == "--help") {
+            args.help = true;
+        } else if (arg.size() > 1 and arg.front() == '-') {
+            throw std::runtime_error("Unknown option " + arg);
+        } else {
+            args.paths.emplace_back(arg);
+        }
+    }
+
+    if (args.batch.tileSize and args.batch.pipelined) {
+        throw std::runtime_error("Tiled recognition can not be pipelined");
+    }
+
+    if (args.batch.coarseFactor and args.batch.pipelined) {
+        throw std::runtime_error("Coarse to fine recognition can not be pipelined");
+    }
+
+    if (args.batch.coarseFactor and args.batch.tileSize) {
+        throw std::runtime_error("Images are recognized either in tiles or coarse to fine");
+    }
+
+    if (not args.cacheDirectory.empty() and (args.batch.pipelined or args.batch.tileSize or args.batch.coarseFactor)) {
+        throw std::runtime_error("Only results of whole images recognized at once are cached");
+    }
+
+    return args;
+}
+
+int run(const Arguments & args) {
 
     /* Due to the simple nature of the input images, we can finetune the threshold */
     /* manually to suit our needs                                                  */
@@ -19,15 +142,70 @@ void run() {
     // However, the following code would work as well
     // ImageAnalyzer<3, HalfRangeThreshold> analyzer;
 
-    analyzer.learn("resources/train/train.bmp");
-    analyzer.recognize("resources/test/test.bmp");
+    analyzer.setThreadPool(std::make_shared<ThreadPool>(args.threads, args.pinned));
+    analyzer.setOutputFormats(args.formats);
+    analyzer.setMappedInput(args.mapped);
+
+    if (not args.cacheDirectory.empty()) {
+        ResultCache::Options cacheOptions;
+        cacheOptions.directory = args.cacheDirectory;
+        cacheOptions.diskCapacity = args.cacheMegabytes << 20;
+        cacheOptions.images = args.cacheImages;
+        analyzer.setResultCache(std::make_shared<ResultCache>(cacheOptions));
+    }
+
+    /* Training is expensive, reuse the model from a previous run if there is one */
+    bool loaded = false;
+
+    if (not args.forceTraining and std::ifstream(args.modelFile)) {
+        try {
+            analyzer.load(args.modelFile);
+            loaded = true;
+        } catch (const std::exception & e) {
+            std::clog << e.what() << ", retraining" << std::endl;
+        }
+    }
+
+    if (not loaded) {
+        analyzer.learn(args.trainFile);
+        analyzer.save(args.modelFile);
+    }
+
+    if (args.paths.empty()) {
+        analyzer.recognize("resources/test/test.bmp");
+        analyzer.flushOutput();
+        return 0;
+    }
+
+    const auto images = batch::collectImages(args.paths);
+
+    std::ofstream file;
+    if (not args.outputFile.empty()) {
+        file.open(args.outputFile);
+        if (not file) {
+            throw std::runtime_error("File " + args.outputFile + " could not be opened");
+        }
+    }
+
+    std::ostream & out = args.outputFile.empty() ? std::cout : file;
+    const size_t failed = batch::process(analyzer, images, args.batch, out);
+    analyzer.flushOutput();
+
+    return failed ? 1 : 0;
 }
 
 int main(int argc, const char * argv[]) {
     try {
-        run();
+        const auto args = parseArguments(argc, argv);
+
+        if (args.help) {
+            std::cout << usage;
+            return 0;
+        }
+
+        return run(args);
     } catch (const std::exception & e) {
-        std::cout << e.what() << std::endl;
+        std::cerr << e.what() << std::endl;
+        return 1;
     }
 }
-
@@ -0,0 +1,247 @@
+#include "model.hpp"
+#include "normalization.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace model {
+
+    static constexpr char magic[4] = { 'I', 'A', 'M', 'D' };
+    static constexpr std::size_t centroidFields = 3;
+
+    static std::uint64_t align(const std::uint64_t offset) {
+        return (offset + 7) & ~std::uint64_t(7);
+    }
+
+    template <typename T>
+    static void writeValue(std::ofstream & out, const T value) {
+        out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    static void pad(std::ofstream & out, const std::uint64_t offset) {
+        while ((std::uint64_t)out.tellp() < offset) {
+            out.put(0);
+        }
+    }
+
+    void save(const std::string & filename, const Contents & contents) {
+
+        if (contents.centroids.size() != contents.objects) {
+            throw std::runtime_error("Model must contain exactly one centroid per object class");
+        }
+        if (contents.normalizationOffsets.size() != contents.normalizationScales.size()) {
+            throw std::runtime_error("Model must contain one normalization scale per offset");
+        }
+
+        // Normalization is applied to the inputs of the network, a model without it may leave it empty
+        const std::uint64_t inputs = contents.topology.empty() ? 0 : contents.topology.front();
+        const std::uint64_t features = contents.normalizationOffsets.size();
+        if (features != inputs and (features or contents.normalization != (std::uint32_t)normalization::Method::none)) {
+            throw std::runtime_error("Model must contain one normalization offset and scale per network input");
+        }
+        if (contents.replaySignals.size() != contents.replayClasses.size() * inputs) {
+            throw std::runtime_error("Model must contain one class per replayed sample");
+        }
+
+        Header header { };
+        std::memcpy(header.magic, magic, sizeof(magic));
+        header.version = version;
+        header.byteOrder = byteOrderMark;
+        header.objects = contents.objects;
+        header.minObjectSize = contents.minObjectSize;
+        header.layerCount = contents.topology.size();
+        header.activation = contents.activation;
+        header.normalization = contents.normalization;
+
+        header.layersOffset = align(sizeof(Header));
+        header.centroidsOffset = align(header.layersOffset + header.layerCount * sizeof(std::uint64_t));
+        header.weightsOffset = align(header.centroidsOffset + contents.objects * centroidFields * sizeof(double));
+        header.weightCount = contents.weights.size();
+        header.rangesOffset = align(header.weightsOffset + header.weightCount * sizeof(double));
+        header.rangeCount = contents.inputRanges.size();
+        header.normalizationOffset = align(header.rangesOffset + header.rangeCount * sizeof(double));
+        header.featureCount = contents.normalizationOffsets.size();
+        header.replayOffset = align(header.normalizationOffset + 2 * header.featureCount * sizeof(double));
+        header.replayCount = contents.replayClasses.size();
+        header.replaySeen = contents.replaySeen;
+        header.fileSize = header.replayOffset + header.replayCount * (inputs + 1) * sizeof(double);
+
+        // Written aside and renamed, so that a failed save leaves the previous model in place
+        const std::string partial = filename + ".partial";
+
+        std::ofstream out(partial, std::ios::binary | std::ios::trunc);
+        if (not out) {
+            throw std::runtime_error("Model file " + partial + " could not be opened for writing");
+        }
+
+        out.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+
+        pad(out, header.layersOffset);
+        for (const auto size : contents.topology) {
+            writeValue<std::uint64_t>(out, size);
+        }
+
+        pad(out, header.centroidsOffset);
+        for (const auto & centroid : contents.centroids) {
+            writeValue<double>(out, centroid.perimeterAreaRatio);
+            writeValue<double>(out, centroid.momentOfInertia);
+            writeValue<double>(out, centroid.objects);
+        }
+
+        pad(out, header.weightsOffset);
+        out.write(reinterpret_cast<const char *>(contents.weights.data()), contents.weights.size() * sizeof(double));
+
+        pad(out, header.rangesOffset);
+        out.write(reinterpret_cast<const char *>(contents.inputRanges.data()), contents.inputRanges.size() * sizeof(double));
+
+        pad(out, header.normalizationOffset);
+        out.write(reinterpret_cast<const char *>(contents.normalizationOffsets.data()), header.featureCount * sizeof(double));
+        out.write(reinterpret_cast<const char *>(contents.normalizationScales.data()), header.featureCount * sizeof(double));
+
+        pad(out, header.replayOffset);
+        out.write(reinterpret_cast<const char *>(contents.replaySignals.data()), contents.replaySignals.size() * sizeof(double));
+        out.write(reinterpret_cast<const char *>(contents.replayClasses.data()), header.replayCount * sizeof(std::uint64_t));
+        out.close();
+
+        std::error_code error;
+        if (out) {
+            std::filesystem::rename(partial, filename, error);
+        }
+        if (not out or error) {
+            std::filesystem::remove(partial, error);
+            throw std::runtime_error("Model file " + filename + " could not be written");
+        }
+    }
+
+    MappedModel::MappedModel(const std::string & filename) {
+
+        const int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Model file " + filename + " could not be opened");
+        }
+
+        struct stat st { };
+        if (::fstat(fd, &st) != 0 or st.st_size < (off_t)sizeof(Header)) {
+            ::close(fd);
+            throw std::runtime_error("Model file " + filename + " is truncated");
+        }
+
+        length = st.st_size;
+        void * mapping = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+
+        if (mapping == MAP_FAILED) {
+            throw std::runtime_error("Model file " + filename + " could not be mapped");
+        }
+
+        data = static_cast<const std::uint8_t *>(mapping);
+
+        try {
+            validate();
+        } catch (...) {
+            ::munmap(const_cast<std::uint8_t *>(data), length);
+            throw;
+        }
+    }
+
+    MappedModel::~MappedModel() {
+        ::munmap(const_cast<std::uint8_t *>(data), length);
+    }
+
+    void MappedModel::validate() const {
+        const auto & h = header();
+
+        if (std::memcmp(h.magic, magic, sizeof(magic)) != 0) {
+            throw std::runtime_error("File is not an image analysis model");
+        }
+        if (h.byteOrder != byteOrderMark) {
+            throw std::runtime_error("Model was saved on a machine with different byte order");
+        }
+        if (h.version != version) {
+            throw std::runtime_error("Unsupported model version " + std::to_string(h.version));
+        }
+
+        const bool fits =
+            h.fileSize <= length and
+            h.layersOffset + h.layerCount * sizeof(std::uint64_t) <= h.fileSize and
+            h.centroidsOffset + h.objects * centroidFields * sizeof(double) <= h.fileSize and
+            h.weightsOffset + h.weightCount * sizeof(double) <= h.fileSize and
+            h.rangesOffset + h.rangeCount * sizeof(double) <= h.fileSize and
+            h.normalizationOffset + 2 * h.featureCount * sizeof(double) <= h.fileSize;
+
+        const bool aligned = not ((h.layersOffset | h.centroidsOffset | h.weightsOffset | h.rangesOffset
+            | h.normalizationOffset | h.replayOffset) & 7);
+
+        if (not fits or not aligned) {
+            throw std::runtime_error("Model file is corrupted");
+        }
+
+        // Layer sizes are known to fit by now, the replay buffer is a row of inputs per sample
+        const auto sizes = topology();
+        const std::uint64_t inputs = sizes.empty() ? 0 : sizes.front();
+        const std::uint64_t classes = sizes.empty() ? 0 : sizes.back();
+
+        if (h.replayCount and (not inputs or inputs > h.fileSize or h.replayCount > h.fileSize
+                or h.replayOffset + h.replayCount * (inputs + 1) * sizeof(double) > h.fileSize)) {
+            throw std::runtime_error("Model file is corrupted");
+        }
+
+        const auto * replayed = replayClasses();
+        for (std::uint64_t i = 0; i < h.replayCount; ++i) {
+            if (replayed[i] >= classes) {
+                throw std::runtime_error("Model file is corrupted");
+            }
+        }
+    }
+
+    const Header & MappedModel::header() const {
+        return *reinterpret_cast<const Header *>(data);
+    }
+
+    std::vector<std::size_t> MappedModel::topology() const {
+        const auto * sizes = reinterpret_cast<const std::uint64_t *>(data + header().layersOffset);
+        return std::vector<std::size_t>(sizes, sizes + header().layerCount);
+    }
+
+    Centroid MappedModel::centroid(const std::size_t idx) const {
+        const auto * fields = reinterpret_cast<const double *>(data + header().centroidsOffset) + idx * centroidFields;
+        return { fields[0], fields[1], (std::uint32_t)fields[2] };
+    }
+
+    const double * MappedModel::weights() const {
+        return reinterpret_cast<const double *>(data + header().weightsOffset);
+    }
+
+    std::vector<double> MappedModel::inputRanges() const {
+        const auto * ranges = reinterpret_cast<const double *>(data + header().rangesOffset);
+        return std::vector<double>(ranges, ranges + header().rangeCount);
+    }
+
+    std::vector<double> MappedModel::normalizationOffsets() const {
+        const auto * offsets = reinterpret_cast<const double *>(data + header().normalizationOffset);
+        return std::vector<double>(offsets, offsets + header().featureCount);
+    }
+
+    std::vector<double> MappedModel::normalizationScales() const {
+        const auto * scales = reinterpret_cast<const double *>(data + header().normalizationOffset) + header().featureCount;
+        return std::vector<double>(scales, scales + header().featureCount);
+    }
+
+    const double * MappedModel::replaySignals() const {
+        return reinterpret_cast<const double *>(data + header().replayOffset);
+    }
+
+    const std::uint64_t * MappedModel::replayClasses() const {
+        const auto inputs = header().layerCount ? topology().front() : 0;
+        return reinterpret_cast<const std::uint64_t *>(data + header().replayOffset) + header().replayCount * inputs;
+    }
+
+}
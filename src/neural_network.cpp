@@ -1,110 +1,204 @@
 #include "neural_network.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
 #include <iostream>
 #include <limits>
+#include <mutex>
+#include <numeric>
+#include <optional>
 #include <stdexcept>
 
+#include "thread_pool.hpp"
 
-Layer::Layer(size_t size) : neurons(size) { }
 
-const Neuron & Layer::operator[](const size_t idx) const {
-    return neurons[idx];
+template <typename Scalar>
+Layer<Scalar>::Layer(const size_t inputs, const size_t neurons) : inputs(inputs), neurons(neurons), weights(inputs * neurons) { }
+
+template <typename Scalar>
+std::size_t Layer<Scalar>::size() const {
+    return neurons;
 }
 
-Neuron & Layer::operator[](const size_t idx) {
-    return neurons[idx];
+template <typename Scalar>
+const Scalar * Layer<Scalar>::row(const size_t neuron) const {
+    return weights.data() + neuron * inputs;
 }
 
-std::size_t Layer::size() const {
-    return neurons.size();
+template <typename Scalar>
+Scalar * Layer<Scalar>::row(const size_t neuron) {
+    return weights.data() + neuron * inputs;
 }
 
-std::vector<Neuron>::iterator Layer::begin() {
-    return neurons.begin();
+template <typename Scalar>
+template <typename Fn>
+void BasicBackpropagationNetwork<Scalar>::withActivation(Fn && fn) const {
+    activ::dispatch(activationKind, std::forward<Fn>(fn));
 }
 
-std::vector<Neuron>::iterator Layer::end() {
-    return neurons.end();
+
+/* Matrix kernels operating on row-major matrices of size rows x cols */
+
+// y = f(W x)
+template <typename Act, typename Scalar>
+static void forwardLayer(const Scalar * w, const size_t rows, const size_t cols, const Scalar * x, Scalar * y) {
+    for (size_t r = 0; r < rows; ++r) {
+        const Scalar * row = w + r * cols;
+        Scalar sum = 0.0;
+
+        for (size_t c = 0; c < cols; ++c) {
+            sum += row[c] * x[c];
+        }
+
+        y[r] = Act::apply(sum);
+    }
 }
 
-std::vector<Neuron>::const_iterator Layer::begin() const {
-    return neurons.begin();
+// e *= f'(y), the derivative is evaluated from the outputs y
+template <typename Act, typename Scalar>
+static void applyDerivative(const Scalar * y, const size_t n, Scalar * e) {
+    for (size_t i = 0; i < n; ++i) {
+        e[i] *= Act::derivative(y[i]);
+    }
 }
 
-std::vector<Neuron>::const_iterator Layer::end() const {
-    return neurons.end();
+// y = W^T x
+template <typename Scalar>
+static void transposedMatVec(const Scalar * w, const size_t rows, const size_t cols, const Scalar * x, Scalar * y) {
+    std::fill(y, y + cols, 0.0);
+
+    for (size_t r = 0; r < rows; ++r) {
+        const Scalar * row = w + r * cols;
+        const Scalar xr = x[r];
+
+        for (size_t c = 0; c < cols; ++c) {
+            y[c] += row[c] * xr;
+        }
+    }
 }
 
-std::vector<Neuron>::const_iterator Layer::cbegin() const {
-    return neurons.cbegin();
+// W += alpha * d x^T
+template <typename Scalar>
+static void rankOneUpdate(Scalar * w, const size_t rows, const size_t cols, const Scalar alpha, const Scalar * d, const Scalar * x) {
+    for (size_t r = 0; r < rows; ++r) {
+        Scalar * row = w + r * cols;
+        const Scalar scale = alpha * d[r];
+
+        for (size_t c = 0; c < cols; ++c) {
+            row[c] += scale * x[c];
+        }
+    }
 }
 
-std::vector<Neuron>::const_iterator Layer::cend() const {
-    return neurons.cend();
+// C = f(A B^T), A is m x k, B is n x k, C is m x n
+template <typename Act, typename Scalar>
+static void forwardBatch(const Scalar * a, const size_t m, const size_t k, const Scalar * b, const size_t n, Scalar * c) {
+    for (size_t i = 0; i < m; ++i) {
+        forwardLayer<Act>(b, n, k, a + i * k, c + i * n);
+    }
 }
 
-namespace activation {
+// C = A B, A is m x n, B is n x k, C is m x k
+template <typename Scalar>
+static void matMul(const Scalar * a, const size_t m, const size_t n, const Scalar * b, const size_t k, Scalar * c) {
+    std::fill(c, c + m * k, 0.0);
+
+    for (size_t i = 0; i < m; ++i) {
+        Scalar * out = c + i * k;
 
-    double sigmoid(const double potential, const double lambda) {
-        const auto exp = std::exp(-1 * lambda * potential);
-        return 1.0 / (1 + exp);
+        for (size_t j = 0; j < n; ++j) {
+            const Scalar * row = b + j * k;
+            const Scalar aij = a[i * n + j];
+
+            for (size_t l = 0; l < k; ++l) {
+                out[l] += aij * row[l];
+            }
+        }
     }
+}
 
-    fn createSigmoid(const double lambda) {
-        return [lambda](const double potential) -> double {
-            return sigmoid(potential, lambda);
-        };
+// G += D^T A, D is m x n, A is m x k, G is n x k
+template <typename Scalar>
+static void accumulateGradient(const Scalar * d, const size_t m, const size_t n, const Scalar * a, const size_t k, Scalar * g) {
+    for (size_t i = 0; i < m; ++i) {
+        rankOneUpdate(g, n, k, Scalar(1), d + i * n, a + i * k);
     }
-    
 }
 
 
-BackpropagationNetwork::BackpropagationNetwork(
-        activ::fn fun, 
+template <typename Scalar>
+BasicBackpropagationNetwork<Scalar>::BasicBackpropagationNetwork(
+        const activ::Kind activation,
         const size_t input, 
         const size_t output, 
         const size_t hiddenLayers, 
         const size_t hiddenLayerNeurons
-    ) : activationFn(std::move(fun)) {
+    ) : activationKind(activation) {
 
     layers.reserve(hiddenLayers + 2);
 
-    layers.emplace_back(input);
+    layers.emplace_back(0, input);
 
     for (std::size_t i = 0; i < hiddenLayers; ++i) {
-        layers.emplace_back(hiddenLayerNeurons);
+        layers.emplace_back(layers.back().size(), hiddenLayerNeurons);
         initLayer(i+1);
     }
 
-    layers.emplace_back(output);
+    layers.emplace_back(layers.back().size(), output);
     initLayer(hiddenLayers + 1);
+
+    for (const auto & layer : layers) {
+        activations.emplace_back(layer.size(), 0.0);
+        errors.emplace_back(layer.size(), 0.0);
+    }
 }
 
-void BackpropagationNetwork::initLayer(const size_t layerIdx) {
-    if (not layerIdx) {
-        return;
+template <typename Scalar>
+template <typename Other>
+BasicBackpropagationNetwork<Scalar>::BasicBackpropagationNetwork(const BasicBackpropagationNetwork<Other> & other) :
+    activationKind(other.activationKind) {
+
+    for (const auto & layer : other.layers) {
+        layers.emplace_back(layer.inputs, layer.neurons);
+        std::copy(layer.weights.begin(), layer.weights.end(), layers.back().weights.begin());
+
+        activations.emplace_back(layer.size(), 0.0);
+        errors.emplace_back(layer.size(), 0.0);
     }
+}
 
-    const auto weigths = layers[layerIdx-1].neurons.size();
-    auto & layer = layers[layerIdx];
+template <typename Scalar>
+activ::Kind BasicBackpropagationNetwork<Scalar>::activationFunction() const {
+    return activationKind;
+}
 
-    for (auto & neuron : layer) {
-        neuron.weights.reserve(weigths);
-        for (size_t i = 0; i < weigths; ++i) {
-            neuron.weights.emplace_back(dist(rnd));
-        }
+template <typename Scalar>
+void BasicBackpropagationNetwork<Scalar>::initialize(const unsigned seed) {
+    rnd.seed(seed);
+
+    for (size_t i = 1; i < layers.size(); ++i) {
+        initLayer(i);
     }
 }
 
+template <typename Scalar>
+void BasicBackpropagationNetwork<Scalar>::initLayer(const size_t layerIdx) {
+    for (auto & weight : layers[layerIdx].weights) {
+        weight = Scalar(dist(rnd));
+    }
+}
 
-size_t BackpropagationNetwork::predict(const std::vector<double> & input) {
 
-    const auto out = outputValues(input);
+template <typename Scalar>
+static size_t argMax(const Scalar * out, const size_t size) {
 
-    double maxVal = 0;
+    // Outputs of tanh networks may all be negative
+    Scalar maxVal = out[0];
     size_t maxIdx = 0;
 
-    for (size_t i = 0; i != out.size(); ++i) {
+    for (size_t i = 1; i < size; ++i) {
         if (out[i] > maxVal) {
             maxVal = out[i];
             maxIdx = i;
@@ -114,69 +208,90 @@ size_t BackpropagationNetwork::predict(const std::vector<double> & input) {
     return maxIdx;
 }
 
-void BackpropagationNetwork::validateInput(const std::vector<double> & input) {
-    if (input.size() != layers.front().size()) {
-        throw std::runtime_error("Input size does not match number of neurons in network input layer.");
-    }
-}
-
-double BackpropagationNetwork::neuronOutput(const Neuron & neuron, const std::vector<double> & inputs) {
-    return activationFn(neuronPotential(neuron, inputs));
+template <typename Scalar>
+size_t BasicBackpropagationNetwork<Scalar>::predict(const std::vector<Scalar> & input) {
+    const auto & out = forward(input);
+    return argMax(out.data(), out.size());
 }
 
-double BackpropagationNetwork::neuronPotential(const Neuron & neuron, const std::vector<double> & inputs) {
+template <typename Scalar>
+void BasicBackpropagationNetwork<Scalar>::predictBatch(const Scalar * samples, const size_t count, size_t * classes) {
 
-    double potential = 0.0;
+    size_t widest = 0;
+    for (const auto & layer : layers) {
+        widest = std::max(widest, layer.size());
+    }
 
-    for (size_t i = 0; i < neuron.weights.size(); ++i) {
-        potential += neuron.weights[i] * inputs[i];
+    if (batchInput.size() < count * widest) {
+        batchInput.resize(count * widest);
+        batchOutput.resize(count * widest);
     }
 
-    return potential;
-}
+    const Scalar * in = samples;
 
-std::vector<double> BackpropagationNetwork::calcLayerValues(const size_t layer, const std::vector<double> & inputs) {
+    for (size_t l = 1; l < layers.size(); ++l) {
+        const auto & layer = layers[l];
 
-    const auto & current = layers[layer];
-    std::vector<double> out(current.size(), 0.0);
+        withActivation([&](auto act) {
+            forwardBatch<decltype(act)>(in, count, layer.inputs, layer.weights.data(), layer.neurons, batchOutput.data());
+        });
 
-    for (size_t i = 0; i < current.size(); ++i) {
-        out[i] = neuronOutput(current[i], inputs);
+        std::swap(batchInput, batchOutput);
+        in = batchInput.data();
     }
 
-    return out;
-}
+    const size_t outputs = layers.back().size();
 
-std::vector<double> BackpropagationNetwork::outputValues(std::vector<double> input) {
-    
-    for (size_t i = 1; i < layers.size(); ++i) {
-        auto next = calcLayerValues(i, input);        
-        input = std::move(next);
+    for (size_t i = 0; i < count; ++i) {
+        classes[i] = argMax(in + i * outputs, outputs);
     }
+}
 
-    return input;
+template <typename Scalar>
+void BasicBackpropagationNetwork<Scalar>::validateInput(const std::vector<Scalar> & input) {
+    if (input.size() != layers.front().size()) {
+        throw std::runtime_error("Input size does not match number of neurons in network input layer.");
+    }
 }
 
-std::vector<std::vector<double>> BackpropagationNetwork::outputsOfAllLayers(const std::vector<double> & inputs) {
+template <typename Scalar>
+void BasicBackpropagationNetwork<Scalar>::calcLayerValues(const size_t layer) {
 
-    std::vector<std::vector<double>> outputs;
-    outputs.reserve(layers.size() - 1);
+    const auto & current = layers[layer];
+    const Scalar * in = activations[layer-1].data();
+    Scalar * out = activations[layer].data();
 
-    outputs.emplace_back(inputs);
+    withActivation([&](auto act) {
+        forwardLayer<decltype(act)>(current.weights.data(), current.neurons, current.inputs, in, out);
+    });
+}
+
+template <typename Scalar>
+const std::vector<Scalar> & BasicBackpropagationNetwork<Scalar>::forward(const std::vector<Scalar> & inputs) {
+
+    validateInput(inputs);
+    std::copy(inputs.begin(), inputs.end(), activations.front().begin());
 
     for (size_t i = 1; i < layers.size(); ++i) {
-        outputs.emplace_back(calcLayerValues(i, outputs[i-1]));
+        calcLayerValues(i);
     }
 
-    return outputs;
+    return activations.back();
+}
+
+template <typename Scalar>
+std::vector<Scalar> BasicBackpropagationNetwork<Scalar>::outputValues(const std::vector<Scalar> & input) {
+    return forward(input);
 }
 
-double BackpropagationNetwork::calcNetworkError(const std::vector<double> & signals, const size_t expected) {
+template <typename Scalar>
+double BasicBackpropagationNetwork<Scalar>::calcNetworkError(const std::vector<Scalar> & signals, const size_t expected) {
 
     double error = 0;
+    const double low = activ::low(activationKind);
     
     for (size_t i = 0; i < signals.size(); ++i) {
-        const double expVal = (i == expected);
+        const double expVal = (i == expected) ? 1.0 : low;
         const double received = signals[i];
         const double err = expVal - received;
         error += err*err;
@@ -185,90 +300,634 @@ double BackpropagationNetwork::calcNetworkError(const std::vector<double> & sign
     return error;
 }
 
-std::vector<double> BackpropagationNetwork::adjustOutputLayer(const std::vector<double> & inputs, const std::vector<double> & outputs, const size_t expected) {
+template <typename Scalar>
+void BasicBackpropagationNetwork<Scalar>::calcOutputErrors(const size_t expected) {
+
+    const auto & outputs = activations.back();
+    auto & err = errors.back();
+
+    const Scalar low = activ::low(activationKind);
 
-    std::vector<double> errors;
-    
     for (size_t i = 0; i < outputs.size(); ++i) {
-        const double expVal = (i == expected);
-        const double received = outputs[i];
-        const double error = (expVal - received) * lambda * received * (1 - received);
-        errors.emplace_back(error);
-
-        Neuron & neuron = layers.back()[i];
-        for (size_t j = 0; j < neuron.weights.size(); ++j) {
-            neuron.weights[j] += eta * error * inputs[j];
+        const Scalar expVal = (i == expected) ? Scalar(1) : low;
+        err[i] = expVal - outputs[i];
+    }
+
+    withActivation([&](auto act) {
+        applyDerivative<decltype(act)>(outputs.data(), outputs.size(), err.data());
+    });
+}
+
+template <typename Scalar>
+void BasicBackpropagationNetwork<Scalar>::calcHiddenErrors(const size_t layer) {
+
+    const auto & following = layers[layer+1];
+    const auto & outputs = activations[layer];
+    auto & err = errors[layer];
+
+    transposedMatVec(following.weights.data(), following.neurons, following.inputs, errors[layer+1].data(), err.data());
+
+    withActivation([&](auto act) {
+        applyDerivative<decltype(act)>(outputs.data(), outputs.size(), err.data());
+    });
+}
+
+template <typename Scalar>
+double BasicBackpropagationNetwork<Scalar>::sampleGradient(const std::vector<Scalar> & signals, const size_t expected, std::vector<Scalar> & gradient) {
+
+    const double error = calcNetworkError(forward(signals), expected);
+
+    // Errors are propagated using the weights from the forward pass
+    calcOutputErrors(expected);
+
+    // No need to calculate errors of the input layer, thus, i != 0
+    for (size_t i = layers.size()-2; i != 0; --i) {
+        calcHiddenErrors(i);
+    }
+
+    std::fill(gradient.begin(), gradient.end(), 0.0);
+    Scalar * g = gradient.data();
+
+    for (size_t i = 1; i < layers.size(); ++i) {
+        const auto & layer = layers[i];
+        rankOneUpdate(g, layer.neurons, layer.inputs, Scalar(1), errors[i].data(), activations[i-1].data());
+        g += layer.weights.size();
+    }
+
+    return error;
+}
+
+template <typename Scalar>
+void BasicBackpropagationNetwork<Scalar>::applyGradient(training::OptimizerState & optimizer, const std::vector<Scalar> & gradient, const double rate) {
+
+    optimizer.beginStep();
+    size_t offset = 0;
+
+    for (size_t i = 1; i < layers.size(); ++i) {
+        auto & weights = layers[i].weights;
+        optimizer.update(weights.data(), gradient.data() + offset, offset, weights.size(), rate);
+        offset += weights.size();
+    }
+}
+
+template <typename Scalar>
+double BasicBackpropagationNetwork<Scalar>::loss(const std::vector<std::vector<Scalar>> & signals, const std::vector<size_t> & expected) {
+
+    double total = 0.0;
+
+    for (size_t i = 0; i < signals.size(); ++i) {
+        total += calcNetworkError(forward(signals[i]), expected[i]);
+    }
+
+    return total / signals.size();
+}
+
+template <typename Scalar>
+double BasicBackpropagationNetwork<Scalar>::accuracy(const std::vector<std::vector<Scalar>> & signals, const std::vector<size_t> & expected) {
+
+    size_t hits = 0;
+
+    for (size_t i = 0; i < signals.size(); ++i) {
+        hits += predict(signals[i]) == expected[i];
+    }
+
+    return hits / double(signals.size());
+}
+
+template <typename Scalar>
+typename BasicBackpropagationNetwork<Scalar>::ShardScratch BasicBackpropagationNetwork<Scalar>::createShardScratch() const {
+    ShardScratch scratch;
+
+    for (const auto & layer : layers) {
+        scratch.activations.emplace_back(shardSize * layer.size(), 0.0);
+        scratch.errors.emplace_back(shardSize * layer.size(), 0.0);
+    }
+
+    return scratch;
+}
+
+template <typename Scalar>
+typename BasicBackpropagationNetwork<Scalar>::BatchError BasicBackpropagationNetwork<Scalar>::shardGradient(
+        const std::vector<std::vector<Scalar>> & signals,
+        const std::vector<size_t> & expected,
+        const size_t begin,
+        const size_t end,
+        ShardScratch & scratch,
+        std::vector<Scalar> & gradient
+    ) const {
+
+    const size_t m = end - begin;
+    auto & act = scratch.activations;
+    auto & err = scratch.errors;
+
+    // Forward pass, one row of each activation matrix per sample
+    for (size_t i = 0; i < m; ++i) {
+        std::copy(signals[begin + i].begin(), signals[begin + i].end(), act.front().begin() + i * layers.front().size());
+    }
+
+    for (size_t l = 1; l < layers.size(); ++l) {
+        const auto & layer = layers[l];
+
+        withActivation([&](auto a) {
+            forwardBatch<decltype(a)>(act[l-1].data(), m, layer.inputs, layer.weights.data(), layer.neurons, act[l].data());
+        });
+    }
+
+    // Output layer errors
+    const size_t outputs = layers.back().size();
+    const Scalar low = activ::low(activationKind);
+    BatchError batchError;
+
+    for (size_t i = 0; i < m; ++i) {
+        const Scalar * out = act.back().data() + i * outputs;
+        Scalar * e = err.back().data() + i * outputs;
+        double sampleError = 0.0;
+
+        for (size_t j = 0; j < outputs; ++j) {
+            const Scalar expVal = (j == expected[begin + i]) ? Scalar(1) : low;
+            const Scalar diff = expVal - out[j];
+            sampleError += double(diff) * diff;
+            e[j] = diff;
         }
+
+        batchError.max = std::max(batchError.max, sampleError);
+        batchError.total += sampleError;
+    }
+
+    withActivation([&](auto a) {
+        applyDerivative<decltype(a)>(act.back().data(), m * outputs, err.back().data());
+    });
+
+    // Hidden layer errors
+    for (size_t l = layers.size()-2; l != 0; --l) {
+        const auto & following = layers[l+1];
+        matMul(err[l+1].data(), m, following.neurons, following.weights.data(), following.inputs, err[l].data());
+
+        withActivation([&](auto a) {
+            applyDerivative<decltype(a)>(act[l].data(), m * layers[l].size(), err[l].data());
+        });
+    }
+
+    // Gradients, stored layer after layer in the same order as the weights
+    std::fill(gradient.begin(), gradient.end(), 0.0);
+    Scalar * g = gradient.data();
+
+    for (size_t l = 1; l < layers.size(); ++l) {
+        const auto & layer = layers[l];
+        accumulateGradient(err[l].data(), m, layer.neurons, act[l-1].data(), layer.inputs, g);
+        g += layer.weights.size();
     }
 
-    return errors;
+    return batchError;
 }
 
-std::vector<double> BackpropagationNetwork::adjustHiddenLayer(const std::vector<double> & inputs, const std::vector<double> & outputs, const size_t layer, const std::vector<double> & followingLayerErrors) {
+template <typename Scalar>
+training::EpochReport BasicBackpropagationNetwork<Scalar>::teach(
+        const std::vector<std::vector<Scalar>> & allSignals,
+        const std::vector<size_t> & allExpected,
+        const training::Options & options
+    ) {
 
-    std::vector<double> errors;
+    for (const auto & input : allSignals) {
+        validateInput(input);
+    }
 
-    auto & currentLayer = layers[layer];
-    auto & followingLayer = layers[layer+1];
+    // Split off the held-out samples used to detect a plateau
+    std::vector<size_t> order(allSignals.size());
+    std::iota(order.begin(), order.end(), 0);
 
-    for (size_t i = 0; i < outputs.size(); ++i) {
-        const double received = outputs[i];
-        double error = 0.0;
+    const size_t held = std::min<size_t>(allSignals.size() - 1, allSignals.size() * options.validationFraction);
+    if (held) {
+        std::shuffle(order.begin(), order.end(), rnd);
+    }
 
-        for (size_t j = 0; j < followingLayer.size(); ++j) {
-            error += followingLayerErrors[j] * followingLayer[j].weights[i];
+    std::vector<std::vector<Scalar>> signals, heldSignals;
+    std::vector<size_t> expected, heldExpected;
+
+    for (size_t i = 0; i < order.size(); ++i) {
+        auto & sig = (i < held) ? heldSignals : signals;
+        auto & exp = (i < held) ? heldExpected : expected;
+        sig.emplace_back(allSignals[order[i]]);
+        exp.emplace_back(allExpected[order[i]]);
+    }
+
+    const size_t batchSize = std::max<size_t>(1, options.batchSize);
+    const size_t maxShards = (batchSize + shardSize - 1) / shardSize;
+
+    // Training runs on the shared pool when there is one, otherwise on a pool of its own
+    std::optional<ThreadPool> ownPool;
+    ThreadPool & pool = options.pool ? *options.pool : ownPool.emplace(batchSize == 1 ? 1 : options.threads);
+
+    // Each slot owns scratch buffers and processes every slots-th shard of a batch
+    const size_t slots = (batchSize == 1) ? 0 : std::min(options.threads ? options.threads : pool.size(), maxShards);
+
+    std::vector<ShardScratch> scratch;
+    for (size_t i = 0; i < slots; ++i) {
+        scratch.emplace_back(createShardScratch());
+    }
+
+    std::vector<std::vector<Scalar>> shardGradients(batchSize > 1 ? maxShards : 0, std::vector<Scalar>(weightCount(), 0.0));
+    std::vector<BatchError> shardErrors(shardGradients.size());
+    std::vector<Scalar> gradient(weightCount(), 0.0);
+
+    training::OptimizerState optimizer(options, weightCount());
+    training::EpochReport report;
+
+    // The initial weights are the best until a finite loss improves on them
+    double bestLoss = std::numeric_limits<double>::infinity();
+    size_t sinceImprovement = 0;
+    std::vector<Scalar> bestWeights(options.patience ? weightCount() : 0);
+    if (options.patience) {
+        exportWeights(bestWeights.data());
+    }
+
+    for (size_t epoch = 0; epoch < options.maxEpochs; ++epoch) {
+
+        const double rate = training::learningRate(options, epoch);
+        BatchError epochError;
+
+        if (batchSize == 1) {
+            for (size_t i = 0; i < signals.size(); ++i) {
+                const double error = sampleGradient(signals[i], expected[i], gradient);
+                epochError.max = std::max(epochError.max, error);
+                epochError.total += error;
+
+                // Samples which are already recognized well enough do not adjust the weights
+                if (error >= options.errorThreshold) {
+                    applyGradient(optimizer, gradient, rate);
+                }
+            }
         }
 
-        error *= lambda * received * (1 - received);
-        errors.emplace_back(error);
+        for (size_t batchBegin = 0; batchSize > 1 and batchBegin < signals.size(); batchBegin += batchSize) {
+
+            const size_t batchEnd = std::min(signals.size(), batchBegin + batchSize);
+            const size_t shards = (batchEnd - batchBegin + shardSize - 1) / shardSize;
+
+            pool.run(std::min(slots, shards), [&](const size_t slot) {
+                for (size_t s = slot; s < shards; s += slots) {
+                    const size_t begin = batchBegin + s * shardSize;
+                    const size_t end = std::min(batchEnd, begin + shardSize);
+                    shardErrors[s] = shardGradient(signals, expected, begin, end, scratch[slot], shardGradients[s]);
+                }
+            });
+
+            // Deterministic reduction in shard order, the mean gradient of the batch is applied
+            const Scalar scale = 1.0 / (batchEnd - batchBegin);
+            std::fill(gradient.begin(), gradient.end(), 0.0);
+
+            for (size_t s = 0; s < shards; ++s) {
+                for (size_t i = 0; i < gradient.size(); ++i) {
+                    gradient[i] += shardGradients[s][i] * scale;
+                }
+                epochError.max = std::max(epochError.max, shardErrors[s].max);
+                epochError.total += shardErrors[s].total;
+            }
+
+            applyGradient(optimizer, gradient, rate);
+        }
+
+        report.epoch = epoch;
+        report.learningRate = rate;
+        report.trainingLoss = epochError.total / signals.size();
+        report.maxError = epochError.max;
+
+        if (not heldSignals.empty()) {
+            report.validationLoss = loss(heldSignals, heldExpected);
+        }
+
+        if (options.onEpoch) {
+            options.onEpoch(report);
+        }
+
+        if (epochError.max < options.errorThreshold) {
+            break;
+        }
+
+        if (options.stopWhen and options.stopWhen(report)) {
+            break;
+        }
 
-        Neuron & neuron = currentLayer[i];
-        for (size_t j = 0; j < neuron.weights.size(); ++j) {
-            neuron.weights[j] += eta * error * inputs[j];
+        if (options.patience) {
+            const double monitored = heldSignals.empty() ? report.trainingLoss : report.validationLoss;
+
+            // A loss which is not finite never counts as an improvement
+            if (std::isfinite(monitored) and monitored < bestLoss - options.minImprovement) {
+                bestLoss = monitored;
+                sinceImprovement = 0;
+                exportWeights(bestWeights.data());
+            } else if (++sinceImprovement >= options.patience) {
+                importWeights(bestWeights.data());
+                break;
+            }
         }
     }
 
-    return errors;
+    return report;
 }
 
-bool BackpropagationNetwork::teachIteration(const std::vector<std::vector<double>> & signals, const std::vector<size_t> & expected) {
+template <typename Scalar>
+training::EpochReport BasicBackpropagationNetwork<Scalar>::update(
+        const std::vector<std::vector<Scalar>> & signals,
+        const std::vector<size_t> & expected,
+        const training::UpdateOptions & options
+    ) {
 
-    double maxError = 0;
+    if (signals.size() != expected.size()) {
+        throw std::runtime_error("Number of samples does not match number of expected classes.");
+    }
 
-    for (size_t i = 0; i < signals.size(); ++i) {
-        const auto error = teach(signals[i], expected[i]);
-        maxError = std::max(error, maxError);
+    for (const auto & input : signals) {
+        validateInput(input);
     }
 
-    return maxError < threshold;
+    training::Options optimizerOptions;
+    optimizerOptions.optimizer = options.optimizer;
+    training::OptimizerState optimizer(optimizerOptions, weightCount());
+
+    ShardScratch scratch = createShardScratch();
+    std::vector<Scalar> gradient(weightCount()), shardGradients(weightCount());
+
+    std::vector<std::vector<Scalar>> batchSignals(signals);
+    std::vector<size_t> batchExpected(expected);
+    std::vector<size_t> replayOrder(replaySignals.size());
+    std::iota(replayOrder.begin(), replayOrder.end(), 0);
+
+    const size_t replayed = std::min(options.replaySamples, replaySignals.size());
+    batchSignals.resize(signals.size() + replayed);
+    batchExpected.resize(signals.size() + replayed);
+
+    training::EpochReport report;
+
+    for (size_t step = 0; step < options.steps and not batchSignals.empty(); ++step) {
+
+        // Partial shuffle draws a different subset of the replay buffer every step
+        for (size_t i = 0; i < replayed; ++i) {
+            std::swap(replayOrder[i], replayOrder[i + rnd() % (replayOrder.size() - i)]);
+            batchSignals[signals.size() + i] = replaySignals[replayOrder[i]];
+            batchExpected[signals.size() + i] = replayExpected[replayOrder[i]];
+        }
+
+        BatchError stepError;
+        std::fill(gradient.begin(), gradient.end(), 0.0);
+
+        for (size_t begin = 0; begin < batchSignals.size(); begin += shardSize) {
+            const size_t end = std::min(batchSignals.size(), begin + shardSize);
+            const auto shardError = shardGradient(batchSignals, batchExpected, begin, end, scratch, shardGradients);
+
+            for (size_t i = 0; i < gradient.size(); ++i) {
+                gradient[i] += shardGradients[i];
+            }
+            stepError.max = std::max(stepError.max, shardError.max);
+            stepError.total += shardError.total;
+        }
+
+        report.epoch = step;
+        report.learningRate = options.learningRate;
+        report.trainingLoss = stepError.total / batchSignals.size();
+        report.maxError = stepError.max;
+
+        if (stepError.max < options.errorThreshold) {
+            break;
+        }
+
+        const Scalar scale = 1.0 / batchSignals.size();
+        for (auto & g : gradient) {
+            g *= scale;
+        }
+
+        applyGradient(optimizer, gradient, options.learningRate);
+    }
+
+    remember(signals, expected, options.replayCapacity);
+
+    return report;
 }
 
-double BackpropagationNetwork::teach(const std::vector<double> & signals, const size_t expected) {
+template <typename Scalar>
+void BasicBackpropagationNetwork<Scalar>::remember(const std::vector<std::vector<Scalar>> & signals, const std::vector<size_t> & expected, const size_t capacity) {
 
-    auto outputs = outputsOfAllLayers(signals);
+    if (replaySignals.size() > capacity) {
+        replaySignals.resize(capacity);
+        replayExpected.resize(capacity);
+    }
+
+    for (size_t i = 0; i < signals.size() and capacity; ++i) {
+        ++replaySeen;
 
-    const double error = calcNetworkError(outputs.back(), expected);
+        if (replaySignals.size() < capacity) {
+            replaySignals.emplace_back(signals[i]);
+            replayExpected.emplace_back(expected[i]);
+            continue;
+        }
 
-    if (error < threshold) {
-        return error;
+        const size_t slot = rnd() % replaySeen;
+        if (slot < capacity) {
+            replaySignals[slot] = signals[i];
+            replayExpected[slot] = expected[i];
+        }
     }
+}
+
+template <typename Scalar>
+training::Selection BasicBackpropagationNetwork<Scalar>::teachBestOf(
+        const std::vector<std::vector<Scalar>> & allSignals,
+        const std::vector<size_t> & allExpected,
+        const training::Options & options,
+        const training::SelectionOptions & selection
+    ) {
+
+    const size_t count = std::max<size_t>(1, selection.candidates);
 
-    std::vector<double> errors = adjustOutputLayer(outputs[outputs.size()-2], outputs[outputs.size()-1], expected);
+    // Every candidate is compared on the same held-out samples
+    std::vector<size_t> order(allSignals.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), std::mt19937(selection.seed));
 
-    // No need to adjust weights on input layer, thus, i != 0
-    for (size_t i = outputs.size()-2; i != 0; --i) {
-        errors = adjustHiddenLayer(outputs[i-1], outputs[i], i, errors);
+    const size_t held = std::min<size_t>(allSignals.size() - 1, allSignals.size() * selection.holdOut);
+
+    std::vector<std::vector<Scalar>> signals, heldSignals;
+    std::vector<size_t> expected, heldExpected;
+
+    for (size_t i = 0; i < order.size(); ++i) {
+        auto & sig = (i < held) ? heldSignals : signals;
+        auto & exp = (i < held) ? heldExpected : expected;
+        sig.emplace_back(allSignals[order[i]]);
+        exp.emplace_back(allExpected[order[i]]);
     }
 
-    return error;
+    if (heldSignals.empty()) {
+        heldSignals = signals;
+        heldExpected = expected;
+    }
+
+    std::vector<BasicBackpropagationNetwork> candidates(count, *this);
+    std::vector<training::EpochReport> reports(count);
+    std::vector<bool> cancelled(count, false);
+
+    // Best held-out loss reached by any candidate at each checkpoint
+    std::mutex checkpointMtx;
+    std::vector<double> bestAtCheckpoint;
+
+    std::optional<ThreadPool> ownPool;
+    ThreadPool & pool = options.pool ? *options.pool : ownPool.emplace(selection.threads);
+
+    const auto trainCandidate = [&](const size_t idx) {
+        auto & candidate = candidates[idx];
+        candidate.initialize(selection.seed + idx);
+
+        training::Options candidateOptions = options;
+        candidateOptions.validationFraction = 0.0;
+        candidateOptions.onEpoch = nullptr;
+        // Batches of the candidates are split on the same pool the candidates run on
+        candidateOptions.pool = &pool;
+
+        if (selection.checkpointEpochs and selection.cancelFactor > 0) {
+            candidateOptions.stopWhen = [&, idx](const training::EpochReport & report) {
+                if ((report.epoch + 1) % selection.checkpointEpochs) {
+                    return false;
+                }
+
+                const double current = candidate.loss(heldSignals, heldExpected);
+                const size_t checkpoint = report.epoch / selection.checkpointEpochs;
+
+                std::lock_guard lock(checkpointMtx);
+                if (bestAtCheckpoint.size() <= checkpoint) {
+                    bestAtCheckpoint.resize(checkpoint + 1, std::numeric_limits<double>::max());
+                }
+
+                auto & best = bestAtCheckpoint[checkpoint];
+                best = std::min(best, current);
+                cancelled[idx] = current > selection.cancelFactor * best;
+
+                return bool(cancelled[idx]);
+            };
+        }
+
+        reports[idx] = candidate.teach(signals, expected, candidateOptions);
+    };
+
+    const size_t slots = std::min(selection.threads ? selection.threads : pool.size(), count);
+    std::atomic<size_t> next { 0 };
+
+    pool.run(slots, [&](const size_t) {
+        for (size_t idx = next++; idx < count; idx = next++) {
+            trainCandidate(idx);
+        }
+    });
+
+    training::Selection result;
+    result.accuracy = -1.0;
+
+    for (size_t idx = 0; idx < count; ++idx) {
+        if (cancelled[idx]) {
+            ++result.cancelled;
+            continue;
+        }
+
+        const double acc = candidates[idx].accuracy(heldSignals, heldExpected);
+        const double err = candidates[idx].loss(heldSignals, heldExpected);
+
+        if (acc > result.accuracy or (acc == result.accuracy and err < result.loss)) {
+            result.candidate = idx;
+            result.seed = selection.seed + idx;
+            result.accuracy = acc;
+            result.loss = err;
+            result.report = reports[idx];
+        }
+    }
+
+    // All candidates were cancelled only if the cancel factor is below one, keep the first one then
+    if (result.accuracy < 0) {
+        result.accuracy = candidates.front().accuracy(heldSignals, heldExpected);
+        result.loss = candidates.front().loss(heldSignals, heldExpected);
+        result.seed = selection.seed;
+        result.report = reports.front();
+    }
+
+    std::vector<Scalar> weights(weightCount());
+    candidates[result.candidate].exportWeights(weights.data());
+    importWeights(weights.data());
 
+    return result;
 }
 
-void BackpropagationNetwork::teach(const std::vector<std::vector<double>> & signals, const std::vector<size_t> & expected) {
-    for (
-        int i = 0;
-        i < iterations and not teachIteration(signals, expected);
-        ++i
-    );
+template <typename Scalar>
+std::vector<size_t> BasicBackpropagationNetwork<Scalar>::topology() const {
+    std::vector<size_t> sizes;
+    sizes.reserve(layers.size());
+
+    for (const auto & layer : layers) {
+        sizes.emplace_back(layer.size());
+    }
+
+    return sizes;
+}
+
+template <typename Scalar>
+size_t BasicBackpropagationNetwork<Scalar>::weightCount() const {
+    size_t count = 0;
+
+    for (const auto & layer : layers) {
+        count += layer.weights.size();
+    }
+
+    return count;
 }
 
+template <typename Scalar>
+void BasicBackpropagationNetwork<Scalar>::exportWeights(Scalar * dest) const {
+    for (const auto & layer : layers) {
+        dest = std::copy(layer.weights.begin(), layer.weights.end(), dest);
+    }
+}
+
+template <typename Scalar>
+void BasicBackpropagationNetwork<Scalar>::importWeights(const Scalar * src) {
+    for (auto & layer : layers) {
+        std::copy(src, src + layer.weights.size(), layer.weights.begin());
+        src += layer.weights.size();
+    }
+}
+
+template <typename Scalar>
+size_t BasicBackpropagationNetwork<Scalar>::replaySize() const {
+    return replaySignals.size();
+}
+
+template <typename Scalar>
+size_t BasicBackpropagationNetwork<Scalar>::replayOffered() const {
+    return replaySeen;
+}
+
+template <typename Scalar>
+void BasicBackpropagationNetwork<Scalar>::exportReplay(Scalar * signals, size_t * expected) const {
+    for (size_t i = 0; i < replaySignals.size(); ++i) {
+        signals = std::copy(replaySignals[i].begin(), replaySignals[i].end(), signals);
+        expected[i] = replayExpected[i];
+    }
+}
+
+template <typename Scalar>
+void BasicBackpropagationNetwork<Scalar>::importReplay(const Scalar * signals, const size_t * expected, const size_t count, const size_t seen) {
+    const size_t inputs = layers.front().size();
+
+    replaySignals.assign(count, std::vector<Scalar>(inputs));
+    replayExpected.assign(expected, expected + count);
+    replaySeen = std::max(seen, count);
+
+    for (auto & sample : replaySignals) {
+        std::copy(signals, signals + inputs, sample.begin());
+        signals += inputs;
+    }
+}
+
+
+template struct Layer<float>;
+template struct Layer<double>;
+
+template class BasicBackpropagationNetwork<float>;
+template class BasicBackpropagationNetwork<double>;
+
+template BasicBackpropagationNetwork<float>::BasicBackpropagationNetwork(const BasicBackpropagationNetwork<double> &);
+template BasicBackpropagationNetwork<double>::BasicBackpropagationNetwork(const BasicBackpropagationNetwork<float> &);
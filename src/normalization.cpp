@@ -0,0 +1,80 @@
+#include "normalization.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+
+Normalizer::Normalizer(const normalization::Method method) : method(method) { }
+
+Normalizer::Normalizer(const normalization::Method method, std::vector<double> offset, std::vector<double> scale) :
+    method(method), offset(std::move(offset)), scale(std::move(scale)) {
+
+    if (this->offset.size() != this->scale.size()) {
+        throw std::runtime_error("Normalization offsets and scales must be of equal size");
+    }
+}
+
+void Normalizer::fit(const std::vector<std::vector<double>> & samples) {
+
+    const size_t features = samples.empty() ? 0 : samples.front().size();
+
+    offset.assign(features, 0.0);
+    scale.assign(features, 1.0);
+
+    if (samples.empty() or method == normalization::Method::none) {
+        return;
+    }
+
+    for (size_t f = 0; f < features; ++f) {
+
+        double spread = 0.0;
+
+        if (method == normalization::Method::standard) {
+            double sum = 0.0;
+            for (const auto & sample : samples) {
+                sum += sample[f];
+            }
+            const double mean = sum / samples.size();
+
+            double variance = 0.0;
+            for (const auto & sample : samples) {
+                variance += (sample[f] - mean) * (sample[f] - mean);
+            }
+
+            offset[f] = mean;
+            spread = std::sqrt(variance / samples.size());
+        } else {
+            double min = std::numeric_limits<double>::max();
+            double max = std::numeric_limits<double>::lowest();
+
+            for (const auto & sample : samples) {
+                min = std::min(min, sample[f]);
+                max = std::max(max, sample[f]);
+            }
+
+            offset[f] = min;
+            spread = max - min;
+        }
+
+        // A constant feature carries no information, it is only shifted
+        scale[f] = spread > 0 ? 1.0 / spread : 1.0;
+    }
+}
+
+void Normalizer::apply(std::vector<double> & sample) const {
+    apply(sample.data(), 1);
+}
+
+normalization::Method Normalizer::getMethod() const {
+    return method;
+}
+
+const std::vector<double> & Normalizer::offsets() const {
+    return offset;
+}
+
+const std::vector<double> & Normalizer::scales() const {
+    return scale;
+}
@@ -0,0 +1,22 @@
+#include "pipeline.hpp"
+
+#include <filesystem>
+#include <stdexcept>
+
+
+pipeline::Source pipeline::files(const std::vector<std::string> & filenames) {
+    return [filenames, next = size_t(0)](Frame & frame) mutable {
+        if (next == filenames.size()) {
+            return false;
+        }
+
+        const auto & filename = filenames[next++];
+        frame.name = std::filesystem::path(filename).stem().string();
+
+        if (not frame.image.loadFromFile(filename)) {
+            throw std::runtime_error("File " + filename + " not found");
+        }
+
+        return true;
+    };
+}
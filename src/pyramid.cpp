@@ -0,0 +1,178 @@
+#include "pyramid.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "pixel.hpp"
+
+
+namespace pyramid {
+
+    Level::Level(
+            const uint32_t width, const uint32_t height, const tiling::RowReader & rows,
+            const uint8_t threshold, const uint32_t factor, ThreadPool & pool
+        ) : factor(factor) {
+
+        if (not factor) {
+            throw std::runtime_error("Cells must not be empty");
+        }
+
+        cellsPerRow = (width + factor - 1) / factor;
+        cellRows = (height + factor - 1) / factor;
+        counts.assign(size_t(cellsPerRow) * cellRows, 0);
+
+        // Every task counts whole rows of cells, so no two tasks touch the same count
+        pool.parallelFor(0, cellRows, 1, [&](const size_t begin, const size_t end) {
+            std::vector<uint8_t> buffer;
+
+            for (size_t cy = begin; cy < end; ++cy) {
+                uint32_t * cells = counts.data() + cy * cellsPerRow;
+
+                for (uint32_t y = cy * factor; y < std::min(height, uint32_t(cy + 1) * factor); ++y) {
+                    rows(y, buffer).scanRow(0, [&](const uint32_t x, const uint8_t current) {
+                        cells[x / factor] += current > threshold;
+                    });
+                }
+            }
+        });
+    }
+
+    uint32_t Level::width() const {
+        return cellsPerRow;
+    }
+
+    uint32_t Level::height() const {
+        return cellRows;
+    }
+
+    uint32_t Level::scale() const {
+        return factor;
+    }
+
+    uint32_t Level::count(const uint32_t x, const uint32_t y) const {
+        return counts[size_t(y) * cellsPerRow + x];
+    }
+
+
+    static uint32_t find(std::vector<uint32_t> & parent, uint32_t cell) {
+        while (parent[cell] != cell) {
+            parent[cell] = parent[parent[cell]];
+            cell = parent[cell];
+        }
+
+        return cell;
+    }
+
+    std::vector<Region> regions(const Level & level, std::vector<uint32_t> & cells) {
+
+        const uint32_t width = level.width();
+        cells.assign(size_t(width) * level.height(), Pixel::noIndex);
+
+        for (uint32_t y = 0; y < level.height(); ++y) {
+            for (uint32_t x = 0; x < width; ++x) {
+                if (not level.count(x, y)) {
+                    continue;
+                }
+
+                const uint32_t cell = y * width + x;
+                cells[cell] = cell;
+
+                for (const uint32_t neighbour : { x ? cell - 1 : cell, y ? cell - width : cell }) {
+                    if (neighbour != cell and cells[neighbour] != Pixel::noIndex) {
+                        const auto r1 = find(cells, neighbour);
+                        const auto r2 = find(cells, cell);
+                        cells[std::max(r1, r2)] = std::min(r1, r2);
+                    }
+                }
+            }
+        }
+
+        // Parents precede their children, so a single pass points every cell at its root
+        for (uint32_t cell = 0; cell < cells.size(); ++cell) {
+            if (cells[cell] != Pixel::noIndex) {
+                cells[cell] = cells[cells[cell]];
+            }
+        }
+
+        // Roots are numbered before any other cell of their region replaces its root by the number
+        std::vector<Region> regions;
+
+        for (uint32_t cell = 0; cell < cells.size(); ++cell) {
+            if (cells[cell] == Pixel::noIndex) {
+                continue;
+            }
+
+            const uint32_t x = cell % width;
+            const uint32_t y = cell / width;
+
+            if (cells[cell] == cell) {
+                cells[cell] = regions.size();
+                regions.push_back({ x, y, x, y, 0 });
+            } else {
+                cells[cell] = cells[cells[cell]];
+            }
+
+            auto & region = regions[cells[cell]];
+            region.left = std::min(region.left, x);
+            region.right = std::max(region.right, x);
+            region.bottom = std::max(region.bottom, y);
+            region.foreground += level.count(x, y);
+        }
+
+        return regions;
+    }
+
+    std::vector<tiling::Component> components(
+            const uint32_t width, const uint32_t height, const tiling::RowReader & rows,
+            const uint8_t threshold, const int minPerimeter, const uint32_t factor, ThreadPool & pool
+        ) {
+
+        const Level level(width, height, rows, threshold, factor, pool);
+
+        std::vector<uint32_t> cells;
+        const auto found = regions(level, cells);
+
+        // The perimeter of an object is at most its area
+        const uint64_t minimum = std::max(minPerimeter, 0);
+
+        std::vector<std::vector<tiling::Component>> objects(found.size());
+
+        pool.run(found.size(), [&](const size_t r) {
+            const auto & region = found[r];
+
+            if (region.foreground < minimum) {
+                return;
+            }
+
+            const uint32_t x0 = region.left * factor;
+            const uint32_t y0 = region.top * factor;
+            const uint32_t x1 = std::min(width, (region.right + 1) * factor);
+            const uint32_t y1 = std::min(height, (region.bottom + 1) * factor);
+
+            // Objects lie within the cells of their region, whose bounding box is labeled. Parts
+            // of other regions within the box are labeled by those regions.
+            auto tile = tiling::label(x0, y0, x1 - x0, y1 - y0, width, height, rows, threshold);
+
+            for (auto & part : tile.parts) {
+                const uint32_t x = part.acc.first / height;
+                const uint32_t y = part.acc.first % height;
+
+                if (cells[size_t(y / factor) * level.width() + x / factor] == r and part.acc.perimeter >= minimum) {
+                    objects[r].emplace_back(std::move(part));
+                }
+            }
+        });
+
+        std::vector<tiling::Component> joined;
+        for (auto & region : objects) {
+            joined.insert(joined.end(), region.begin(), region.end());
+        }
+
+        // The same order as filterBySize
+        std::sort(joined.begin(), joined.end(), [](const auto & c1, const auto & c2) {
+            return c1.acc.first < c2.acc.first;
+        });
+
+        return joined;
+    }
+}
@@ -0,0 +1,239 @@
+#include "quantization.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+
+namespace quantization {
+
+    std::ostream & operator<<(std::ostream & os, const Report & report) {
+        return os << "samples: " << report.samples
+                  << ", accuracy double: " << report.doubleAccuracy
+                  << ", float: " << report.floatAccuracy
+                  << ", int8: " << report.int8Accuracy
+                  << ", int8 agreement: " << report.agreement
+                  << ", max output error: " << report.maxOutputError;
+    }
+
+}
+
+
+static constexpr int quantMax = 127;
+
+static float scaleFor(const double range) {
+    return range > 0 ? range / quantMax : 1.0f;
+}
+
+static std::int8_t quantize(const float value, const float scale) {
+    const long q = std::lround(value / scale);
+    return std::clamp<long>(q, -quantMax, quantMax);
+}
+
+static size_t argMax(const float * out, const size_t size) {
+
+    // Outputs of tanh networks may all be negative
+    float maxVal = out[0];
+    size_t maxIdx = 0;
+
+    for (size_t i = 1; i != size; ++i) {
+        if (out[i] > maxVal) {
+            maxVal = out[i];
+            maxIdx = i;
+        }
+    }
+
+    return maxIdx;
+}
+
+/* Largest absolute input value of every layer with weights, obtained by a */
+/* double precision forward pass of the calibration signals                */
+static std::vector<double> calibrate(const BackpropagationNetwork & trained, const std::vector<std::vector<double>> & calibration) {
+
+    const auto topology = trained.topology();
+    std::vector<double> weights(trained.weightCount());
+    trained.exportWeights(weights.data());
+
+    std::vector<double> ranges(topology.size() - 1, 0.0);
+
+    for (const auto & signal : calibration) {
+        std::vector<double> in = signal;
+        const double * w = weights.data();
+
+        for (size_t l = 1; l < topology.size(); ++l) {
+            for (const auto value : in) {
+                ranges[l-1] = std::max(ranges[l-1], std::abs(value));
+            }
+
+            std::vector<double> out(topology[l], 0.0);
+
+            for (size_t r = 0; r < topology[l]; ++r) {
+                double sum = 0.0;
+                for (size_t c = 0; c < topology[l-1]; ++c) {
+                    sum += w[r * topology[l-1] + c] * in[c];
+                }
+                out[r] = sum;
+            }
+
+            activ::dispatch(trained.activationFunction(), [&](auto act) {
+                for (auto & value : out) {
+                    value = decltype(act)::apply(value);
+                }
+            });
+
+            w += topology[l] * topology[l-1];
+            in = std::move(out);
+        }
+    }
+
+    return ranges;
+}
+
+
+QuantizedNetwork::QuantizedNetwork(const BackpropagationNetwork & trained, const std::vector<std::vector<double>> & calibration) :
+    QuantizedNetwork(trained, calibrate(trained, calibration)) { }
+
+QuantizedNetwork::QuantizedNetwork(const BackpropagationNetwork & trained, std::vector<double> inputRanges) :
+    activationKind(trained.activationFunction()),
+    ranges(std::move(inputRanges)) {
+
+    if (ranges.size() + 1 != trained.topology().size()) {
+        throw std::runtime_error("Quantization requires one input range per layer with weights");
+    }
+
+    quantizeLayers(trained);
+}
+
+void QuantizedNetwork::quantizeLayers(const BackpropagationNetwork & trained) {
+
+    const auto topology = trained.topology();
+    std::vector<double> weights(trained.weightCount());
+    trained.exportWeights(weights.data());
+
+    const double * w = weights.data();
+    size_t widest = topology.front();
+
+    for (size_t l = 1; l < topology.size(); ++l) {
+        QuantizedLayer layer { topology[l-1], topology[l], { }, { }, scaleFor(ranges[l-1]) };
+
+        for (size_t r = 0; r < layer.neurons; ++r) {
+            const double * row = w + r * layer.inputs;
+
+            double maxAbs = 0.0;
+            for (size_t c = 0; c < layer.inputs; ++c) {
+                maxAbs = std::max(maxAbs, std::abs(row[c]));
+            }
+
+            const float scale = scaleFor(maxAbs);
+            layer.weightScales.emplace_back(scale);
+
+            for (size_t c = 0; c < layer.inputs; ++c) {
+                layer.weights.emplace_back(quantize(row[c], scale));
+            }
+        }
+
+        w += layer.weights.size();
+        widest = std::max(widest, layer.neurons);
+        layers.emplace_back(std::move(layer));
+    }
+
+    quantized.resize(widest);
+    values.resize(widest);
+}
+
+const std::vector<double> & QuantizedNetwork::inputRanges() const {
+    return ranges;
+}
+
+const std::vector<float> & QuantizedNetwork::forward(const float * input) {
+
+    std::copy(input, input + layers.front().inputs, values.begin());
+
+    for (const auto & layer : layers) {
+
+        for (size_t c = 0; c < layer.inputs; ++c) {
+            quantized[c] = quantize(values[c], layer.inputScale);
+        }
+
+        activ::dispatch(activationKind, [&](auto act) {
+            for (size_t r = 0; r < layer.neurons; ++r) {
+                const std::int8_t * row = layer.weights.data() + r * layer.inputs;
+                std::int32_t acc = 0;
+
+                for (size_t c = 0; c < layer.inputs; ++c) {
+                    acc += std::int32_t(row[c]) * quantized[c];
+                }
+
+                values[r] = decltype(act)::apply(acc * layer.weightScales[r] * layer.inputScale);
+            }
+        });
+    }
+
+    return values;
+}
+
+std::vector<float> QuantizedNetwork::outputValues(const std::vector<float> & input) {
+    const auto & out = forward(input.data());
+    return std::vector<float>(out.begin(), out.begin() + layers.back().neurons);
+}
+
+size_t QuantizedNetwork::predict(const std::vector<float> & input) {
+    if (input.size() != layers.front().inputs) {
+        throw std::runtime_error("Input size does not match number of neurons in network input layer.");
+    }
+
+    return argMax(forward(input.data()).data(), layers.back().neurons);
+}
+
+void QuantizedNetwork::predictBatch(const float * samples, const size_t count, size_t * classes) {
+    const size_t inputs = layers.front().inputs;
+
+    for (size_t i = 0; i < count; ++i) {
+        classes[i] = argMax(forward(samples + i * inputs).data(), layers.back().neurons);
+    }
+}
+
+quantization::Report QuantizedNetwork::compare(
+        const BackpropagationNetwork & reference,
+        QuantizedNetwork & quantized,
+        const std::vector<std::vector<double>> & signals,
+        const std::vector<size_t> & expected
+    ) {
+
+    BackpropagationNetwork doubleNet = reference;
+    BasicBackpropagationNetwork<float> floatNet(reference);
+
+    quantization::Report report;
+    report.samples = signals.size();
+
+    size_t doubleHits = 0, floatHits = 0, int8Hits = 0, agreed = 0;
+
+    for (size_t i = 0; i < signals.size(); ++i) {
+        const std::vector<float> input(signals[i].begin(), signals[i].end());
+
+        const auto expectedOutput = doubleNet.outputValues(signals[i]);
+        const auto output = quantized.outputValues(input);
+
+        const size_t doubleClass = doubleNet.predict(signals[i]);
+        const size_t floatClass = floatNet.predict(input);
+        const size_t int8Class = argMax(output.data(), output.size());
+
+        doubleHits += doubleClass == expected[i];
+        floatHits += floatClass == expected[i];
+        int8Hits += int8Class == expected[i];
+        agreed += int8Class == doubleClass;
+
+        for (size_t j = 0; j < output.size(); ++j) {
+            report.maxOutputError = std::max(report.maxOutputError, std::abs(expectedOutput[j] - output[j]));
+        }
+    }
+
+    if (report.samples) {
+        report.doubleAccuracy = doubleHits / double(report.samples);
+        report.floatAccuracy = floatHits / double(report.samples);
+        report.int8Accuracy = int8Hits / double(report.samples);
+        report.agreement = agreed / double(report.samples);
+    }
+
+    return report;
+}
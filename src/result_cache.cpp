@@ -0,0 +1,453 @@
+#include "result_cache.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <tuple>
+
+#include <unistd.h>
+
+
+static constexpr char magic[4] = { 'I', 'A', 'R', 'C' };
+static constexpr uint32_t version = 2;
+static constexpr uint32_t byteOrderMark = 0x01020304;
+
+static constexpr uint64_t prime1 = 0x9E3779B185EBCA87ull;
+static constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+static constexpr uint64_t prime3 = 0x165667B19E3779F9ull;
+static constexpr uint64_t prime5 = 0x27D4EB2F165667C5ull;
+
+static uint64_t rotl(const uint64_t value, const int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static size_t sizeOf(const ResultCache::Result & result) {
+    return sizeof(result)
+        + result.objects.size() * sizeof(Object)
+        + result.signals.size() * sizeof(signals::ObjectSignals)
+        + result.reconstruction.rgba.size()
+        + result.annotation.rgba.size();
+}
+
+
+template <typename T>
+static void put(std::vector<char> & out, const T value) {
+    const auto * bytes = reinterpret_cast<const char *>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+/* Reads the value at offset and moves past it, false if the data ends before it */
+template <typename T>
+static bool take(const std::vector<char> & data, size_t & offset, T & value) {
+    if (data.size() - offset < sizeof(T)) {
+        return false;
+    }
+
+    std::memcpy(&value, data.data() + offset, sizeof(T));
+    offset += sizeof(T);
+
+    return true;
+}
+
+static void putRendered(std::vector<char> & out, const ResultCache::Rendered & rendered) {
+    put<uint32_t>(out, rendered.width);
+    put<uint32_t>(out, rendered.height);
+    put<uint64_t>(out, rendered.rgba.size());
+    out.insert(out.end(), rendered.rgba.begin(), rendered.rgba.end());
+}
+
+static bool takeRendered(const std::vector<char> & data, size_t & offset, ResultCache::Rendered & rendered) {
+    uint64_t size = 0;
+
+    if (not take(data, offset, rendered.width) or not take(data, offset, rendered.height) or not take(data, offset, size)) {
+        return false;
+    }
+    if (size != uint64_t(rendered.width) * rendered.height * 4 or size > data.size() - offset) {
+        return false;
+    }
+
+    rendered.rgba.assign(data.begin() + offset, data.begin() + offset + size);
+    offset += size;
+
+    return true;
+}
+
+
+ResultCache::ResultCache() : ResultCache(Options()) { }
+
+ResultCache::ResultCache(const Options & options) : options(options) {
+    if (options.directory.empty()) {
+        return;
+    }
+
+    std::filesystem::create_directories(options.directory);
+
+    // Results of earlier runs count towards the capacity, the least recently used go first
+    std::vector<std::tuple<std::filesystem::file_time_type, uint64_t, uint64_t>> found;
+    std::error_code error;
+
+    for (const auto & entry : std::filesystem::directory_iterator(options.directory, error)) {
+        const auto name = entry.path().filename().string();
+
+        char * end = nullptr;
+        const uint64_t key = std::strtoull(name.c_str(), &end, 16);
+
+        if (name.size() != 23 or end != name.c_str() + 16 or entry.path().extension() != ".result") {
+            continue;
+        }
+
+        const auto time = entry.last_write_time(error);
+        const auto size = entry.file_size(error);
+
+        if (not error) {
+            found.emplace_back(time, key, size);
+        }
+    }
+
+    std::sort(found.begin(), found.end());
+
+    std::vector<std::string> victims;
+    for (const auto & [time, key, size] : found) {
+        const auto removed = touch(key, size);
+        victims.insert(victims.end(), removed.begin(), removed.end());
+    }
+
+    for (const auto & victim : victims) {
+        std::filesystem::remove(victim, error);
+    }
+}
+
+uint64_t ResultCache::hash(const void * data, const size_t size, const uint64_t seed) {
+    const auto * bytes = static_cast<const uint8_t *>(data);
+
+    uint64_t h = seed + prime5 + size;
+    size_t i = 0;
+
+    // Whole words first, which is where nearly all the time goes
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, 8);
+
+        h ^= rotl(word * prime2, 31) * prime1;
+        h = rotl(h, 27) * prime1 + prime3;
+    }
+
+    for (; i < size; ++i) {
+        h ^= bytes[i] * prime5;
+        h = rotl(h, 11) * prime1;
+    }
+
+    h ^= h >> 33;
+    h *= prime2;
+    h ^= h >> 29;
+    h *= prime3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+uint64_t ResultCache::hash(const ImageView & img, ThreadPool & pool) {
+    const size_t rowBytes = size_t(img.width()) * bytesPerPixel(img.format());
+
+    // Rows are hashed in parallel, padding between rows is left out
+    std::vector<uint64_t> rows(img.height());
+
+    pool.parallelFor(0, img.height(), 64, [&](const size_t begin, const size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+            rows[y] = hash(img.row(y), rowBytes, y);
+        }
+    });
+
+    const uint64_t shape[] = { img.width(), img.height(), uint64_t(img.format()) };
+
+    return hash(rows.data(), rows.size() * sizeof(uint64_t), hash(shape, sizeof(shape)));
+}
+
+uint64_t ResultCache::hash(const std::string & filename) {
+    std::ifstream in(filename, std::ios::binary);
+    if (not in) {
+        throw std::runtime_error("File " + filename + " not found");
+    }
+
+    std::vector<char> chunk(size_t(1) << 20);
+    uint64_t h = 0;
+
+    while (in) {
+        in.read(chunk.data(), chunk.size());
+        h = hash(chunk.data(), in.gcount(), h);
+    }
+
+    return h;
+}
+
+bool ResultCache::storesImages() const {
+    return options.images;
+}
+
+std::string ResultCache::path(const uint64_t key) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.result", (unsigned long long)key);
+
+    return (std::filesystem::path(options.directory) / name).string();
+}
+
+void ResultCache::remember(const uint64_t key, Result result) {
+    // Called with the mutex held
+    const auto found = index.find(key);
+    if (found != index.end()) {
+        bytes -= sizeOf(found->second->second);
+        entries.erase(found->second);
+        index.erase(found);
+    }
+
+    bytes += sizeOf(result);
+    entries.emplace_front(key, std::move(result));
+    index[key] = entries.begin();
+
+    while (bytes > options.capacity and entries.size() > 1) {
+        bytes -= sizeOf(entries.back().second);
+        index.erase(entries.back().first);
+        entries.pop_back();
+    }
+}
+
+std::vector<std::string> ResultCache::touch(const uint64_t key, const uint64_t size) {
+    // Called with the mutex held
+    const auto found = fileIndex.find(key);
+    if (found != fileIndex.end()) {
+        diskBytes -= found->second->second;
+        files.erase(found->second);
+        fileIndex.erase(found);
+    }
+
+    if (size) {
+        diskBytes += size;
+        files.emplace_front(key, size);
+        fileIndex[key] = files.begin();
+    }
+
+    std::vector<std::string> victims;
+
+    while (diskBytes > options.diskCapacity and files.size() > 1) {
+        victims.emplace_back(path(files.back().first));
+        diskBytes -= files.back().second;
+        fileIndex.erase(files.back().first);
+        files.pop_back();
+    }
+
+    return victims;
+}
+
+std::optional<ResultCache::Result> ResultCache::find(const uint64_t key) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+
+        const auto found = index.find(key);
+        if (found != index.end()) {
+            entries.splice(entries.begin(), entries, found->second);
+            ++hitCount;
+            return found->second->second;
+        }
+    }
+
+    if (options.directory.empty()) {
+        ++missCount;
+        return std::nullopt;
+    }
+
+    const auto file = path(key);
+    std::error_code error;
+    std::vector<std::string> victims;
+    Result result;
+
+    const bool hit = read(key, result);
+
+    if (hit) {
+        ++hitCount;
+
+        // The time of last use orders the files for eviction by later runs
+        std::filesystem::last_write_time(file, std::filesystem::file_time_type::clock::now(), error);
+        const auto size = std::filesystem::file_size(file, error);
+
+        std::lock_guard<std::mutex> lock(mtx);
+        victims = touch(key, error ? 0 : size);
+        remember(key, result);
+    } else {
+        ++missCount;
+
+        // A file which can not be read is removed, so that it is not read again
+        std::filesystem::remove(file, error);
+
+        std::lock_guard<std::mutex> lock(mtx);
+        victims = touch(key, 0);
+    }
+
+    for (const auto & victim : victims) {
+        std::filesystem::remove(victim, error);
+    }
+
+    if (not hit) {
+        return std::nullopt;
+    }
+
+    return result;
+}
+
+static std::vector<char> serialize(const uint64_t key, const ResultCache::Result & result) {
+    std::vector<char> data(magic, magic + sizeof(magic));
+
+    put<uint32_t>(data, version);
+    put<uint32_t>(data, byteOrderMark);
+    put<uint64_t>(data, key);
+    put<uint64_t>(data, result.objects.size());
+    put<uint64_t>(data, result.signals.size());
+
+    for (const auto & object : result.objects) {
+        put<uint32_t>(data, object.id);
+        put<uint32_t>(data, object.bounds.leftTop.x);
+        put<uint32_t>(data, object.bounds.leftTop.y);
+        put<uint32_t>(data, object.bounds.rightBottom.x);
+        put<uint32_t>(data, object.bounds.rightBottom.y);
+        put<uint32_t>(data, object.type);
+    }
+
+    for (const auto & sig : result.signals) {
+        put<uint32_t>(data, sig.index);
+        put<double>(data, sig.perimeterAreaRatio);
+        put<double>(data, sig.momentOfInertia);
+    }
+
+    putRendered(data, result.reconstruction);
+    putRendered(data, result.annotation);
+
+    // A hash of everything before it detects files which were damaged after they were written
+    put<uint64_t>(data, ResultCache::hash(data.data(), data.size(), key));
+
+    return data;
+}
+
+bool ResultCache::read(const uint64_t key, Result & result) const {
+
+    // Files which are missing, damaged or written by another version are misses
+    const auto file = path(key);
+
+    std::error_code error;
+    const uint64_t fileSize = std::filesystem::file_size(file, error);
+    if (error or fileSize < sizeof(magic) + sizeof(uint64_t)) {
+        return false;
+    }
+
+    std::vector<char> data(fileSize);
+    std::ifstream in(file, std::ios::binary);
+
+    if (not in.read(data.data(), data.size())) {
+        return false;
+    }
+
+    uint64_t checksum;
+    std::memcpy(&checksum, data.data() + data.size() - sizeof(checksum), sizeof(checksum));
+    data.resize(data.size() - sizeof(checksum));
+
+    if (checksum != hash(data.data(), data.size(), key) or std::memcmp(data.data(), magic, sizeof(magic)) != 0) {
+        return false;
+    }
+
+    size_t offset = sizeof(magic);
+    uint32_t fileVersion = 0, bom = 0;
+    uint64_t fileKey = 0, objectCount = 0, signalCount = 0;
+
+    const bool header = take(data, offset, fileVersion) and take(data, offset, bom) and take(data, offset, fileKey)
+        and take(data, offset, objectCount) and take(data, offset, signalCount);
+
+    if (not header or fileVersion != version or bom != byteOrderMark or fileKey != key
+            or objectCount > data.size() or signalCount > data.size()) {
+        return false;
+    }
+
+    result.objects.resize(objectCount);
+    result.signals.resize(signalCount);
+
+    for (auto & object : result.objects) {
+        const bool complete = take(data, offset, object.id)
+            and take(data, offset, object.bounds.leftTop.x) and take(data, offset, object.bounds.leftTop.y)
+            and take(data, offset, object.bounds.rightBottom.x) and take(data, offset, object.bounds.rightBottom.y)
+            and take(data, offset, object.type);
+
+        if (not complete) {
+            return false;
+        }
+    }
+
+    for (auto & sig : result.signals) {
+        if (not take(data, offset, sig.index) or not take(data, offset, sig.perimeterAreaRatio) or not take(data, offset, sig.momentOfInertia)) {
+            return false;
+        }
+    }
+
+    return takeRendered(data, offset, result.reconstruction) and takeRendered(data, offset, result.annotation)
+        and offset == data.size();
+}
+
+void ResultCache::insert(const uint64_t key, Result result) {
+
+    if (not options.images) {
+        result.reconstruction = { };
+        result.annotation = { };
+    }
+
+    std::vector<std::string> victims;
+    uint64_t written = 0;
+
+    if (not options.directory.empty()) {
+        // Written aside and renamed, so that readers never see a partial file. Every writer of
+        // this process or of another one sharing the directory writes a file of its own.
+        static std::atomic<uint64_t> writes { 0 };
+
+        const auto file = path(key);
+        const auto partial = file + "." + std::to_string(::getpid()) + "." + std::to_string(writes++) + ".partial";
+        const auto data = serialize(key, result);
+
+        std::ofstream out(partial, std::ios::binary | std::ios::trunc);
+        out.write(data.data(), data.size());
+        out.close();
+
+        // A result which can not be persisted is still kept in memory
+        std::error_code error;
+        if (out) {
+            std::filesystem::rename(partial, file, error);
+        }
+        if (not out or error) {
+            std::clog << "Result " << file << " could not be written" << std::endl;
+            std::filesystem::remove(partial, error);
+        } else {
+            written = data.size();
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+
+        if (written) {
+            victims = touch(key, written);
+        }
+        remember(key, std::move(result));
+    }
+
+    std::error_code error;
+    for (const auto & victim : victims) {
+        std::filesystem::remove(victim, error);
+    }
+}
+
+size_t ResultCache::hits() const {
+    return hitCount;
+}
+
+size_t ResultCache::misses() const {
+    return missCount;
+}
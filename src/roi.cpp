@@ -0,0 +1,200 @@
+#include "roi.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+
+#include "pyramid.hpp"
+
+
+namespace roi {
+
+    /* Side of the cells in which masks are split into regions */
+    static constexpr uint32_t maskCell = 16;
+
+    static bool touch(const Rect & r1, const Rect & r2) {
+        // Neighbouring pixels of two rectangles may belong to the same object
+        return r1.x <= r2.x + r2.width and r2.x <= r1.x + r1.width
+            and r1.y <= r2.y + r2.height and r2.y <= r1.y + r1.height;
+    }
+
+    static bool inside(const Rect & rect, const uint32_t x, const uint32_t y) {
+        return x >= rect.x and x - rect.x < rect.width and y >= rect.y and y - rect.y < rect.height;
+    }
+
+    static uint32_t find(std::vector<uint32_t> & parent, uint32_t rect) {
+        while (parent[rect] != rect) {
+            parent[rect] = parent[parent[rect]];
+            rect = parent[rect];
+        }
+
+        return rect;
+    }
+
+    std::vector<Region> regions(const std::vector<Rect> & rects, const uint32_t width, const uint32_t height) {
+
+        std::vector<Rect> clipped;
+
+        for (const auto & rect : rects) {
+            if (rect.x >= width or rect.y >= height) {
+                continue;
+            }
+
+            const uint32_t w = std::min(rect.width, width - rect.x);
+            const uint32_t h = std::min(rect.height, height - rect.y);
+
+            if (w and h) {
+                clipped.push_back({ rect.x, rect.y, w, h });
+            }
+        }
+
+        std::vector<uint32_t> parent(clipped.size());
+
+        for (uint32_t i = 0; i < clipped.size(); ++i) {
+            parent[i] = i;
+
+            for (uint32_t j = 0; j < i; ++j) {
+                if (touch(clipped[i], clipped[j])) {
+                    parent[find(parent, i)] = find(parent, j);
+                }
+            }
+        }
+
+        std::vector<std::vector<Rect>> groups(clipped.size());
+        for (uint32_t i = 0; i < clipped.size(); ++i) {
+            groups[find(parent, i)].emplace_back(clipped[i]);
+        }
+
+        std::vector<Region> found;
+
+        for (auto & group : groups) {
+            if (group.empty()) {
+                continue;
+            }
+
+            uint32_t left = width, top = height, right = 0, bottom = 0;
+
+            for (const auto & rect : group) {
+                left = std::min(left, rect.x);
+                top = std::min(top, rect.y);
+                right = std::max(right, rect.x + rect.width);
+                bottom = std::max(bottom, rect.y + rect.height);
+            }
+
+            Region region;
+            region.bounds = { left, top, right - left, bottom - top };
+
+            if (group.size() == 1) {
+                region.contains = [](const uint32_t, const uint32_t) { return true; };
+            } else {
+                region.contains = [rects = std::move(group)](const uint32_t x, const uint32_t y) {
+                    return std::any_of(rects.begin(), rects.end(), [&](const Rect & rect) { return inside(rect, x, y); });
+                };
+            }
+
+            found.emplace_back(std::move(region));
+        }
+
+        return found;
+    }
+
+    std::vector<Region> regions(const ImageView & mask, ThreadPool & pool) {
+
+        if (mask.format() != PixelFormat::gray8) {
+            throw std::runtime_error("Masks must be gray");
+        }
+
+        const auto rows = [&](const uint32_t y, std::vector<uint8_t> &) {
+            return mask.crop(0, y, mask.width(), 1);
+        };
+
+        // Cells of the mask which hold a pixel of it, connected cells form a region
+        const pyramid::Level level(mask.width(), mask.height(), rows, 0, maskCell, pool);
+
+        auto cells = std::make_shared<std::vector<uint32_t>>();
+        const auto cellRegions = pyramid::regions(level, *cells);
+
+        std::vector<Region> found;
+
+        for (uint32_t r = 0; r < cellRegions.size(); ++r) {
+            const auto & cr = cellRegions[r];
+
+            const uint32_t left = cr.left * maskCell;
+            const uint32_t top = cr.top * maskCell;
+            const uint32_t right = std::min(mask.width(), (cr.right + 1) * maskCell);
+            const uint32_t bottom = std::min(mask.height(), (cr.bottom + 1) * maskCell);
+
+            Region region;
+            region.bounds = { left, top, right - left, bottom - top };
+
+            // Pixels of other regions may lie within the bounds, but never next to a pixel of this one
+            region.contains = [mask, cells, r, cellsPerRow = level.width()](const uint32_t x, const uint32_t y) {
+                return mask.row(y)[x] and (*cells)[size_t(y / maskCell) * cellsPerRow + x / maskCell] == r;
+            };
+
+            found.emplace_back(std::move(region));
+        }
+
+        return found;
+    }
+
+    std::vector<uint8_t> pixels(const ImageView & img, const Region & region) {
+
+        const auto & bounds = region.bounds;
+
+        if (bounds.x + bounds.width > img.width() or bounds.y + bounds.height > img.height()) {
+            throw std::runtime_error("Region exceeds the image");
+        }
+
+        std::vector<uint8_t> found;
+
+        for (uint32_t y = 0; y < bounds.height; ++y) {
+            img.crop(bounds.x, bounds.y + y, bounds.width, 1).scanRow(0, [&](const uint32_t x, const uint8_t current) {
+                if (region.contains(bounds.x + x, bounds.y + y)) {
+                    found.push_back(current);
+                }
+            });
+        }
+
+        return found;
+    }
+
+    std::vector<tiling::Component> components(
+            const ImageView & img, const Region & region,
+            const uint8_t threshold, const int minPerimeter, ThreadPool & pool
+        ) {
+
+        const auto & bounds = region.bounds;
+
+        if (bounds.x + bounds.width > img.width() or bounds.y + bounds.height > img.height()) {
+            throw std::runtime_error("Region exceeds the image");
+        }
+
+        // Luminance of the pixels within the bounds, zero is background whatever the threshold
+        std::vector<uint8_t> luminance(size_t(bounds.width) * bounds.height, 0);
+
+        pool.parallelFor(0, bounds.height, 16, [&](const size_t begin, const size_t end) {
+            for (uint32_t y = begin; y < end; ++y) {
+                uint8_t * row = luminance.data() + size_t(y) * bounds.width;
+
+                img.crop(bounds.x, bounds.y + y, bounds.width, 1).scanRow(0, [&](const uint32_t x, const uint8_t current) {
+                    row[x] = region.contains(bounds.x + x, bounds.y + y) ? current : 0;
+                });
+            }
+        });
+
+        const ImageView view(luminance.data(), bounds.width, bounds.height, 0, PixelFormat::gray8);
+
+        const auto rows = [&](const uint32_t y, std::vector<uint8_t> &) {
+            return view.crop(0, y, view.width(), 1);
+        };
+
+        auto objects = tiling::components(bounds.width, bounds.height, rows, threshold, minPerimeter, { }, pool);
+
+        for (auto & object : objects) {
+            object.translate(bounds.x, bounds.y, bounds.height, img.height());
+        }
+
+        return objects;
+    }
+}
@@ -0,0 +1,274 @@
+#include "scanline_reader.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__unix__) or defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define IMAGE_ANALYSIS_MMAP
+#endif
+
+
+static uint32_t read16(const uint8_t * p) {
+    return p[0] | uint32_t(p[1]) << 8;
+}
+
+static uint32_t read32(const uint8_t * p) {
+    return read16(p) | read16(p + 2) << 16;
+}
+
+/* Next whitespace separated token of a PNM header, skipping comments */
+static std::string pnmToken(std::istream & in) {
+    std::string token;
+
+    for (int c = in.get(); c != EOF; c = in.get()) {
+        if (c == '#' and token.empty()) {
+            in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        } else if (std::isspace(c)) {
+            if (not token.empty()) {
+                break;
+            }
+        } else {
+            token += char(c);
+        }
+    }
+
+    return token;
+}
+
+bool ScanlineReader::readHeader(std::istream & in, Header & header) {
+
+    char magic[2];
+    if (not in.read(magic, sizeof(magic))) {
+        return false;
+    }
+
+    if (magic[0] == 'B' and magic[1] == 'M') {
+        uint8_t file[54];
+        in.seekg(0);
+        if (not in.read(reinterpret_cast<char *>(file), sizeof(file))) {
+            return false;
+        }
+
+        const uint32_t infoSize = read32(file + 14);
+        const int32_t width = read32(file + 18);
+        const int32_t height = read32(file + 22);
+        const uint32_t compression = read32(file + 30);
+        const uint32_t colorsUsed = read32(file + 46);
+        const uint32_t bits = read16(file + 28);
+
+        // Only plain uncompressed bitmaps are streamed, anything else is left to SFML
+        if (infoSize < 40 or compression != 0 or width <= 0 or height == 0) {
+            return false;
+        }
+        if (bits != 1 and bits != 4 and bits != 8 and bits != 24 and bits != 32) {
+            return false;
+        }
+
+        header.width = width;
+        header.height = (height < 0) ? -int64_t(height) : height;
+        header.bottomUp = height > 0;
+        header.bitsPerPixel = bits;
+        header.offset = read32(file + 10);
+
+        if (bits <= 8) {
+            const uint32_t colors = std::min<uint32_t>(colorsUsed ? colorsUsed : 1u << bits, 256);
+
+            in.seekg(14 + infoSize);
+            for (uint32_t i = 0; i < colors; ++i) {
+                uint8_t bgrx[4];
+                if (not in.read(reinterpret_cast<char *>(bgrx), sizeof(bgrx))) {
+                    return false;
+                }
+                header.luminance[i] = util::bw(sf::Color(bgrx[2], bgrx[1], bgrx[0]));
+            }
+        }
+
+        header.stride = (size_t(header.width) * header.bitsPerPixel + 31) / 32 * 4;
+        header.paletted = header.bitsPerPixel <= 8;
+        header.format = header.paletted ? PixelFormat::gray8 : (header.bitsPerPixel == 24) ? PixelFormat::bgr24 : PixelFormat::bgra32;
+
+        return true;
+    }
+
+    if (magic[0] == 'P' and (magic[1] == '5' or magic[1] == '6')) {
+        try {
+            const auto width = std::stoul(pnmToken(in));
+            const auto height = std::stoul(pnmToken(in));
+            const auto maxValue = std::stoul(pnmToken(in));
+
+            // Rows are handed out as stored, so only samples spanning 0 - 255 are read here,
+            // other ranges would need rescaling and are left to SFML
+            if (not width or not height or maxValue != 255) {
+                return false;
+            }
+
+            header.width = width;
+            header.height = height;
+        } catch (const std::logic_error &) {
+            return false;
+        }
+
+        // A single whitespace character, consumed by pnmToken, separates the header from the pixels
+        header.offset = in.tellg();
+        header.format = (magic[1] == '5') ? PixelFormat::gray8 : PixelFormat::rgb24;
+        header.bitsPerPixel = bytesPerPixel(header.format) * 8;
+        header.stride = size_t(header.width) * bytesPerPixel(header.format);
+
+        return true;
+    }
+
+    return false;
+}
+
+bool ScanlineReader::canRead(const std::string & filename) {
+    std::ifstream in(filename, std::ios::binary);
+    Header header;
+
+    return in and readHeader(in, header);
+}
+
+
+ScanlineReader::ScanlineReader(const std::string & filename, const bool mapped) : filename(filename) {
+
+    std::ifstream in(filename, std::ios::binary);
+    if (not in) {
+        throw std::runtime_error("File " + filename + " could not be opened");
+    }
+
+    if (not readHeader(in, header)) {
+        throw std::runtime_error("File " + filename + " is not an uncompressed BMP, PGM or PPM image");
+    }
+
+    in.seekg(0, std::ios::end);
+    if (size_t(in.tellg()) < header.offset + header.stride * header.height) {
+        throw std::runtime_error("File " + filename + " is truncated");
+    }
+
+#ifdef IMAGE_ANALYSIS_MMAP
+    if (mapped) {
+        const int fd = open(filename.c_str(), O_RDONLY);
+        struct stat info;
+
+        if (fd < 0 or fstat(fd, &info) != 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            throw std::runtime_error("File " + filename + " could not be mapped");
+        }
+
+        void * addr = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+
+        if (addr == MAP_FAILED) {
+            throw std::runtime_error("File " + filename + " could not be mapped");
+        }
+
+        // Rows are mostly read in order, only the bands of a parallel read jump around
+        madvise(addr, info.st_size, MADV_SEQUENTIAL);
+
+        mapping = static_cast<const uint8_t *>(addr);
+        mappingSize = info.st_size;
+    }
+#else
+    // Without mmap, rows are read from the file
+    (void)mapped;
+#endif
+}
+
+ScanlineReader::~ScanlineReader() {
+#ifdef IMAGE_ANALYSIS_MMAP
+    if (mapping) {
+        munmap(const_cast<uint8_t *>(mapping), mappingSize);
+    }
+#endif
+}
+
+uint32_t ScanlineReader::width() const {
+    return header.width;
+}
+
+uint32_t ScanlineReader::height() const {
+    return header.height;
+}
+
+bool ScanlineReader::mapped() const {
+    return mapping;
+}
+
+size_t ScanlineReader::rowOffset(const uint32_t y) const {
+    return header.offset + (header.bottomUp ? header.height - 1 - y : y) * header.stride;
+}
+
+ImageView ScanlineReader::decode(const uint8_t * src, std::vector<uint8_t> & buffer) const {
+
+    if (not header.paletted) {
+        return ImageView(src, header.width, 1, header.stride, header.format);
+    }
+
+    const uint32_t bits = header.bitsPerPixel;
+    const uint32_t mask = (1u << bits) - 1;
+
+    buffer.resize(header.width);
+
+    for (uint32_t x = 0; x < header.width; ++x) {
+        const size_t bit = size_t(x) * bits;
+        const uint32_t entry = (src[bit / 8] >> (8 - bits - bit % 8)) & mask;
+
+        buffer[x] = header.luminance[entry];
+    }
+
+    return ImageView(buffer.data(), header.width, 1, 0, PixelFormat::gray8);
+}
+
+void ScanlineReader::scan(const std::function<void(uint32_t, const ImageView &)> & fn) const {
+    std::vector<uint8_t> buffer;
+
+    if (mapping) {
+        for (uint32_t y = 0; y < header.height; ++y) {
+            fn(y, row(y, buffer));
+        }
+        return;
+    }
+
+    std::ifstream in(filename, std::ios::binary);
+    in.seekg(header.offset);
+
+    std::vector<uint8_t> line(header.stride);
+
+    // Rows are read in the order of the file, bottom-up bitmaps hand out their last row first
+    for (uint32_t i = 0; i < header.height; ++i) {
+        if (not in.read(reinterpret_cast<char *>(line.data()), line.size())) {
+            throw std::runtime_error("File " + filename + " could not be read");
+        }
+
+        fn(header.bottomUp ? header.height - 1 - i : i, decode(line.data(), buffer));
+    }
+}
+
+ImageView ScanlineReader::row(const uint32_t y, std::vector<uint8_t> & buffer) const {
+    if (mapping) {
+        return decode(mapping + rowOffset(y), buffer);
+    }
+
+    std::ifstream in(filename, std::ios::binary);
+    in.seekg(rowOffset(y));
+
+    std::vector<uint8_t> line(header.stride);
+    if (not in.read(reinterpret_cast<char *>(line.data()), line.size())) {
+        throw std::runtime_error("File " + filename + " could not be read");
+    }
+
+    if (header.paletted) {
+        return decode(line.data(), buffer);
+    }
+
+    buffer = std::move(line);
+    return decode(buffer.data(), buffer);
+}
@@ -1,170 +1,148 @@
 #include "signals.hpp"
 
 #include <cmath>
-#include <iostream>
-#include <functional>
+#include <algorithm>
 
 namespace signals {
 
-    typedef std::unordered_map<uint32_t, std::pair<uint32_t, uint32_t>> IntPairMap;
-    typedef std::unordered_map<uint32_t, std::pair<double, double>> DoublePairMap;
-    typedef std::unordered_map<uint32_t, double> SignalMap;
-
-    SignalMap emptyMap() {
-        return {};
-    }
-
-    template <typename T>
-    std::unordered_map<uint32_t, std::pair<T, T>> emptyPairs() {
-        return {};
+    void Accumulator::addPixel(const uint32_t x, const uint32_t y, const uint32_t height, const bool boundary) {
+        ++area;
+        sumX += x;
+        sumY += y;
+        sumXX += uint64_t(x) * x;
+        sumYY += uint64_t(y) * y;
+        sumXY += uint64_t(x) * y;
+        perimeter += boundary;
+        first = std::min(first, uint64_t(x) * height + y);
     }
 
-    void forAll(const Image & img, const std::function<void(uint32_t, uint32_t, const Pixel & px)> & fn) {
-
-        for (uint32_t yc = 0; yc < img.height(); ++yc) {
-            for (uint32_t xc = 0; xc < img.width(); ++xc) {
-                const auto & px = img.at(xc, yc);
-                fn(xc, yc, px);
-            }
-        }
+    void Accumulator::merge(const Accumulator & other) {
+        area += other.area;
+        sumX += other.sumX;
+        sumY += other.sumY;
+        sumXX += other.sumXX;
+        sumYY += other.sumYY;
+        sumXY += other.sumXY;
+        perimeter += other.perimeter;
+        first = std::min(first, other.first);
     }
 
-    auto moment(const Image & img, const int xExp, const int yExp) {
+    bool isBoundary(const Image & img, const uint32_t x, const uint32_t y, const uint32_t index) {
+        const bool left = (not x) or (img.at(x-1, y).index != index);
+        const bool right = (x >= img.width() - 1) or (img.at(x+1, y).index != index);
 
-        auto moments = emptyMap();
+        const bool up = (not y) or (img.at(x, y-1).index != index);
+        const bool down = (y >= img.height() - 1) or (img.at(x, y+1).index != index);
 
-        const auto fn = [&moments, xExp, yExp](const uint32_t x, const uint32_t y, const Pixel & px) {
-            if (not px.isIndexed()) {
-                return;
-            }
-
-            moments[px.index] += std::pow(x, xExp) * std::pow(y, yExp);
-        };
-
-        forAll(img, fn);
-
-        return moments;
+        return left or right or up or down;
     }
 
-    auto centerOfMass(const Image & img, const SignalMap & m0) {
-        auto sig = emptyPairs<double>();
+    std::vector<Accumulator> accumulate(const Image & img, ThreadPool & pool) {
 
-        const auto m10 = moment(img, 1, 0);
-        const auto m01 = moment(img, 0, 1);
+        if (not img.height()) {
+            return {};
+        }
 
-        for (const auto & [idx, m] : m0) {
-            const auto xm = m10.at(idx);
-            const auto ym = m01.at(idx);
+        // Every band of rows sums into its own accumulators, the bands are merged afterwards
+        const size_t bands = std::min<size_t>(img.height(), 4 * pool.size());
+        std::vector<std::vector<Accumulator>> partial(bands);
 
-            sig[idx] = { xm / (double)m, ym / double(m) };
-        }
+        pool.run(bands, [&](const size_t band) {
+            auto & acc = partial[band];
 
-        return sig;
-    }
+            for (uint32_t y = band * img.height() / bands; y < (band + 1) * img.height() / bands; ++y) {
+                for (uint32_t x = 0; x < img.width(); ++x) {
+                    const auto & px = img.at(x, y);
 
-    auto mu(const Image & img, const DoublePairMap & massCenter, const int xExp, const int yExp) {
+                    if (not px.isIndexed()) {
+                        continue;
+                    }
 
-        auto muMap = emptyMap();
+                    if (acc.size() <= px.index) {
+                        acc.resize(px.index + 1);
+                    }
 
-        const auto fn = [&massCenter, &muMap, xExp, yExp](const uint32_t x, const uint32_t y, const Pixel & px) {
-            if (not px.isIndexed()) {
-                return;
+                    acc[px.index].addPixel(x, y, img.height(), isBoundary(img, x, y, px.index));
+                }
             }
+        });
 
-            const auto [xcm, ycm] = massCenter.at(px.index);
+        std::vector<Accumulator> total;
 
-            muMap[px.index] += std::pow(x - xcm, xExp) * std::pow(y - ycm, yExp);
-        };
+        for (const auto & acc : partial) {
+            if (total.size() < acc.size()) {
+                total.resize(acc.size());
+            }
 
-        forAll(img, fn);
+            for (size_t i = 0; i < acc.size(); ++i) {
+                total[i].merge(acc[i]);
+            }
+        }
 
-        return muMap;
+        return total;
     }
 
-    auto circumference(const Image & img) {
-        auto sig = emptyMap();
-
-        const auto fn = [&sig, &img](const uint32_t x, const uint32_t y, const Pixel & px) {
-            if (not px.isIndexed()) {
-                return;
-            }
+    ObjectSignals toSignals(const uint32_t index, const Accumulator & acc) {
 
-            const bool left = (not x) or (img.at(x-1, y).index != px.index);
-            const bool right = (x >= img.width() - 1) or (img.at(x+1, y).index != px.index);
+        const double m = acc.area;
+        const double c = acc.perimeter;
 
-            const bool up = (not y) or (img.at(x, y-1).index != px.index);
-            const bool down = (y >= img.height() - 1) or (img.at(x, y+1).index != px.index);
+        // Central moments derived from the raw sums
+        const double mu20 = acc.sumXX - double(acc.sumX) * acc.sumX / m;
+        const double mu02 = acc.sumYY - double(acc.sumY) * acc.sumY / m;
+        const double mu11 = acc.sumXY - double(acc.sumX) * acc.sumY / m;
 
-            sig[px.index] += left or right or up or down;
-        };
+        const auto left = 0.5 * (mu20 + mu02);
+        const auto right = 0.5 * std::sqrt(4*mu11*mu11 + std::pow(mu20 - mu02, 2));
 
-        forAll(img, fn);
+        const auto muMax = left + right;
+        const auto muMin = left - right;
 
-        return sig;
+        return { index, (c * c) / (100 * m), muMin / muMax };
     }
 
-    SignalMap perimeterAreaRatio(const Image & img, const SignalMap & area) {
-        auto sig = emptyMap();
-
-        const auto circ = circumference(img);
-
-        for (const auto & [idx, a] : area) {
-            const auto c = circ.at(idx);
-            std::cout << "Object " << idx << " , perimeter: " << c << " , area: " << a << std::endl;
-
-            sig[idx] = (c * c) / (100 * a);
-        }
-
-        return sig;
+    std::unordered_map<uint32_t, double> getPerimeters(const Image & img) {
+        return getPerimeters(img, ThreadPool::sequential());
     }
 
-    SignalMap momentOfInertia(const Image & img, const SignalMap & m0) {
-        auto sig = emptyMap();
-
-        const auto massCenter = centerOfMass(img, m0);
-        const auto mu20 = mu(img, massCenter, 2, 0);
-        const auto mu02 = mu(img, massCenter, 0, 2);
-        const auto mu11 = mu(img, massCenter, 1, 1);
-
-        for (const auto & [idx, m11] : mu11) {
-            const auto m20 = mu20.at(idx);
-            const auto m02 = mu02.at(idx);
+    std::unordered_map<uint32_t, double> getPerimeters(const Image & img, ThreadPool & pool) {
+        const auto acc = accumulate(img, pool);
 
-            const auto left = 0.5 * (m20 + m02);
-            const auto right = 0.5 * std::sqrt(4*m11*m11 + std::pow(m20 - m02, 2));
+        std::unordered_map<uint32_t, double> perimeters;
 
-            const auto muMax = left + right;
-            const auto muMin = left - right;
-
-            sig[idx] = muMin / muMax;
+        for (uint32_t idx = 0; idx < acc.size(); ++idx) {
+            if (acc[idx].area) {
+                perimeters[idx] = acc[idx].perimeter;
+            }
         }
 
-        return sig;
+        return perimeters;
     }
 
-    std::unordered_map<uint32_t, double> getPerimeters(const Image & img) {
-        return circumference(img);
+    std::unordered_map<uint32_t, ObjectSignals> getSignals(const Image & img) {
+        return getSignals(img, ThreadPool::sequential());
     }
 
-    std::unordered_map<uint32_t, double> getArea(const Image & img) {
-        return moment(img, 0, 0);
-    }
+    std::unordered_map<uint32_t, ObjectSignals> getSignals(const Image & img, ThreadPool & pool) {
+        const auto acc = accumulate(img, pool);
 
-    std::unordered_map<uint32_t, ObjectSignals> getSignals(const Image & img) {
-        const auto m0 = getArea(img);
-        const auto par = perimeterAreaRatio(img, m0);
-        const auto moi = momentOfInertia(img, m0);
+        std::vector<ObjectSignals> computed(acc.size());
 
-        std::unordered_map<uint32_t, ObjectSignals> sig;
+        pool.parallelFor(0, acc.size(), 64, [&](const size_t begin, const size_t end) {
+            for (size_t idx = begin; idx < end; ++idx) {
+                computed[idx] = toSignals(idx, acc[idx]);
+            }
+        });
 
-        for (const auto & [idx, p] : par) {
-            const auto m = moi.at(idx);
+        std::unordered_map<uint32_t, ObjectSignals> sig;
 
-            sig[idx] = { idx, p, m };
+        for (uint32_t idx = 0; idx < acc.size(); ++idx) {
+            if (acc[idx].area) {
+                sig[idx] = computed[idx];
+            }
         }
 
         return sig;
     }
 
 }
-
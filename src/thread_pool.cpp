@@ -0,0 +1,186 @@
+#include "thread_pool.hpp"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+/* Identifies the pool and queue a worker thread belongs to */
+static thread_local const ThreadPool * currentPool = nullptr;
+static thread_local size_t currentQueue = 0;
+
+
+static void pinToCore(std::thread & thread, const size_t core) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core % std::max(1u, std::thread::hardware_concurrency()), &set);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+    (void)thread;
+    (void)core;
+#endif
+}
+
+
+ThreadPool::ThreadPool(const size_t threads, const bool pinned) {
+
+    const size_t count = std::max<size_t>(1, threads ? threads : std::thread::hardware_concurrency());
+
+    for (size_t i = 0; i < count; ++i) {
+        queues.emplace_back(std::make_unique<Queue>());
+    }
+
+    for (size_t i = 0; i + 1 < count; ++i) {
+        workers.emplace_back(&ThreadPool::work, this, i);
+
+        if (pinned) {
+            pinToCore(workers.back(), i + 1);
+        }
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(sleepMtx);
+        stop = true;
+    }
+    wake.notify_all();
+
+    for (auto & worker : workers) {
+        worker.join();
+    }
+}
+
+ThreadPool & ThreadPool::sequential() {
+    static ThreadPool pool(1);
+    return pool;
+}
+
+ThreadPool & ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+size_t ThreadPool::size() const {
+    return workers.size() + 1;
+}
+
+size_t ThreadPool::home() const {
+    return (currentPool == this) ? currentQueue : queues.size() - 1;
+}
+
+void ThreadPool::work(const size_t idx) {
+    currentPool = this;
+    currentQueue = idx;
+
+    while (true) {
+        if (runQueued(idx)) {
+            continue;
+        }
+
+        std::unique_lock lock(sleepMtx);
+        wake.wait(lock, [&]() { return stop or queued.load() != 0; });
+
+        if (stop) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    auto & queue = *queues[home()];
+
+    {
+        std::lock_guard lock(queue.mtx);
+        queue.tasks.emplace_back(std::move(task));
+    }
+
+    {
+        std::lock_guard lock(sleepMtx);
+        ++queued;
+    }
+    wake.notify_one();
+}
+
+bool ThreadPool::runQueued(const size_t own) {
+    std::function<void()> task;
+
+    // Own tasks are taken newest first, they are the most likely to be in cache
+    {
+        auto & queue = *queues[own];
+        std::lock_guard lock(queue.mtx);
+
+        if (not queue.tasks.empty()) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+    }
+
+    // Others are robbed of their oldest tasks, which tend to be the largest ones
+    for (size_t i = 1; not task and i < queues.size(); ++i) {
+        auto & queue = *queues[(own + i) % queues.size()];
+        std::lock_guard lock(queue.mtx);
+
+        if (not queue.tasks.empty()) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+    }
+
+    if (not task) {
+        return false;
+    }
+
+    --queued;
+    task();
+
+    return true;
+}
+
+void ThreadPool::execute(const size_t count, const std::function<void(size_t)> & task) {
+
+    std::atomic<size_t> remaining { count };
+    std::mutex errorMtx;
+    std::exception_ptr error;
+
+    const auto runTask = [&](const size_t i) {
+        try {
+            task(i);
+        } catch (...) {
+            std::lock_guard lock(errorMtx);
+            if (not error) {
+                error = std::current_exception();
+            }
+        }
+        // The pool outlives this call, unlike the captures of this lambda once remaining drops to zero
+        auto & mtx = sleepMtx;
+        auto & done = wake;
+
+        if (remaining.fetch_sub(1) == 1) {
+            std::lock_guard lock(mtx);
+            done.notify_all();
+        }
+    };
+
+    for (size_t i = 1; i < count; ++i) {
+        submit([&runTask, i]() { runTask(i); });
+    }
+
+    // The calling thread takes the first task and helps with queued ones until all are done
+    runTask(0);
+
+    // Without queued tasks to help with, the thread sleeps until the last task of this call is done
+    const size_t own = home();
+    while (remaining.load()) {
+        if (not runQueued(own)) {
+            std::unique_lock lock(sleepMtx);
+            wake.wait(lock, [&]() { return remaining.load() == 0 or queued.load() != 0; });
+        }
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
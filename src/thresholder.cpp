@@ -9,25 +9,37 @@
 #include <SFML/System.hpp>
 
 
-static std::pair<uint8_t, uint8_t> findMinMax(const sf::Image & src) {
+static std::pair<uint8_t, uint8_t> findMinMax(const ImageView & src) {
     uint8_t min = 255;
     uint8_t max = 0;
 
-    for (uint32_t y = 0; y < src.getSize().y; ++y) {
-        for (uint32_t x = 0; x < src.getSize().x; ++x) {
-            const auto current = util::bw(src.getPixel(x, y));
-            
+    for (uint32_t y = 0; y < src.height(); ++y) {
+        src.scanRow(y, [&](uint32_t, const uint8_t current) {
             min = std::min(min, current);
             max = std::max(max, current);
-        }
+        });
     }
 
     return { min, max };
 }
 
 
-uint8_t HalfRangeThreshold::findThreshold(const sf::Image & img) {
+uint8_t HalfRangeThreshold::findThreshold(const ImageView & img) {
     const auto [min, max] = findMinMax(img);
     return min + (max-min)/2;
 }
 
+uint8_t HalfRangeThreshold::findThreshold(const ScanlineReader & img) {
+    uint8_t min = 255;
+    uint8_t max = 0;
+
+    img.scan([&](uint32_t, const ImageView & row) {
+        const auto [rowMin, rowMax] = findMinMax(row);
+
+        min = std::min(min, rowMin);
+        max = std::max(max, rowMax);
+    });
+
+    return min + (max-min)/2;
+}
+
@@ -0,0 +1,319 @@
+#include "tiling.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+#include "pixel.hpp"
+
+
+namespace tiling {
+
+    void Component::addPixel(const uint32_t x, const uint32_t y, const uint32_t height, const bool boundary) {
+        acc.addPixel(x, y, height, boundary);
+        left = std::min(left, x);
+        top = std::min(top, y);
+        right = std::max(right, x);
+        bottom = std::max(bottom, y);
+    }
+
+    void Component::merge(const Component & other) {
+        acc.merge(other.acc);
+        left = std::min(left, other.left);
+        top = std::min(top, other.top);
+        right = std::max(right, other.right);
+        bottom = std::max(bottom, other.bottom);
+    }
+
+    void Component::translate(const uint32_t x, const uint32_t y, const uint32_t height, const uint32_t imageHeight) {
+        const uint64_t dx = x;
+        const uint64_t dy = y;
+
+        acc.sumXX += 2 * dx * acc.sumX + dx * dx * acc.area;
+        acc.sumYY += 2 * dy * acc.sumY + dy * dy * acc.area;
+        acc.sumXY += dy * acc.sumX + dx * acc.sumY + dx * dy * acc.area;
+        acc.sumX += dx * acc.area;
+        acc.sumY += dy * acc.area;
+
+        // Column-major order within a rectangle is the same as within the image
+        acc.first = (acc.first / height + dx) * imageHeight + acc.first % height + dy;
+
+        left += x;
+        top += y;
+        right += x;
+        bottom += y;
+    }
+
+    bool Component::operator==(const Component & other) const {
+        return acc.area == other.acc.area and acc.sumX == other.acc.sumX and acc.sumY == other.acc.sumY
+            and acc.sumXX == other.acc.sumXX and acc.sumYY == other.acc.sumYY and acc.sumXY == other.acc.sumXY
+            and acc.perimeter == other.acc.perimeter and acc.first == other.acc.first
+            and left == other.left and top == other.top and right == other.right and bottom == other.bottom;
+    }
+
+
+    static uint32_t find(std::vector<uint32_t> & parent, uint32_t px) {
+        while (parent[px] != px) {
+            parent[px] = parent[parent[px]];
+            px = parent[px];
+        }
+
+        return px;
+    }
+
+    static void unite(std::vector<uint32_t> & parent, const uint32_t px1, const uint32_t px2) {
+        const auto r1 = find(parent, px1);
+        const auto r2 = find(parent, px2);
+
+        if (r1 < r2) {
+            parent[r2] = r1;
+        } else if (r2 < r1) {
+            parent[r1] = r2;
+        }
+    }
+
+    Tile label(
+            const uint32_t x0, const uint32_t y0, const uint32_t width, const uint32_t height,
+            const uint32_t imageWidth, const uint32_t imageHeight,
+            const RowReader & rows, const uint8_t threshold
+        ) {
+
+        // Foreground of the tile surrounded by a ring of its neighbours, which tells the
+        // pixels on the edges of the tile whether they lie on the perimeter of their object
+        const uint32_t haloWidth = width + 2;
+        std::vector<uint8_t> foreground(size_t(haloWidth) * (height + 2), 0);
+
+        const uint32_t from = x0 ? x0 - 1 : 0;
+        const uint32_t to = std::min(imageWidth, x0 + width + 1);
+        std::vector<uint8_t> buffer;
+
+        for (uint32_t hy = 0; hy < height + 2; ++hy) {
+            if ((not y0 and not hy) or y0 + hy - 1 >= imageHeight) {
+                continue;
+            }
+
+            uint8_t * row = foreground.data() + size_t(hy) * haloWidth + (from + 1 - x0);
+
+            rows(y0 + hy - 1, buffer).crop(from, 0, to - from, 1).scanRow(0, [&](const uint32_t x, const uint8_t current) {
+                row[x] = current > threshold;
+            });
+        }
+
+        // Pixel (x, y) of the tile lies at (x + 1, y + 1) of the halo
+        const auto halo = [&](const uint32_t hx, const uint32_t hy) -> bool {
+            return foreground[size_t(hy) * haloWidth + hx];
+        };
+        const auto isForeground = [&](const uint32_t x, const uint32_t y) {
+            return halo(x + 1, y + 1);
+        };
+
+        std::vector<uint32_t> label(size_t(width) * height, Pixel::noIndex);
+
+        for (uint32_t y = 0; y < height; ++y) {
+            for (uint32_t x = 0; x < width; ++x) {
+                if (not isForeground(x, y)) {
+                    continue;
+                }
+
+                const uint32_t px = y * width + x;
+                label[px] = px;
+
+                if (x and isForeground(x-1, y)) {
+                    unite(label, px - 1, px);
+                }
+                if (y and isForeground(x, y-1)) {
+                    unite(label, px - width, px);
+                }
+            }
+        }
+
+        Tile tile;
+        tile.x = x0;
+        tile.y = y0;
+        tile.width = width;
+        tile.height = height;
+
+        // Parents precede their children, so a single pass points every pixel at its root
+        for (uint32_t px = 0; px < label.size(); ++px) {
+            if (label[px] != Pixel::noIndex) {
+                label[px] = label[label[px]];
+            }
+        }
+
+        // Roots are numbered before any other pixel of their part replaces its root by the number
+        for (uint32_t px = 0; px < label.size(); ++px) {
+            if (label[px] == Pixel::noIndex) {
+                continue;
+            }
+
+            if (label[px] == px) {
+                label[px] = tile.parts.size();
+                tile.parts.emplace_back();
+            } else {
+                label[px] = label[label[px]];
+            }
+
+            const uint32_t x = px % width;
+            const uint32_t y = px / width;
+
+            const bool boundary = not halo(x, y + 1) or not halo(x + 2, y + 1) or not halo(x + 1, y) or not halo(x + 1, y + 2);
+            tile.parts[label[px]].addPixel(x0 + x, y0 + y, imageHeight, boundary);
+        }
+
+        tile.top.assign(label.begin(), label.begin() + width);
+        tile.bottom.assign(label.end() - width, label.end());
+
+        for (uint32_t y = 0; y < height; ++y) {
+            tile.left.emplace_back(label[size_t(y) * width]);
+            tile.right.emplace_back(label[size_t(y) * width + width - 1]);
+        }
+
+        return tile;
+    }
+
+    Stitcher::Stitcher(const uint32_t width, const int minPerimeter) :
+        minPerimeter(std::max(minPerimeter, 0)),
+        above(width, Pixel::noIndex) { }
+
+    void Stitcher::add(const std::vector<Tile> & strip) {
+
+        std::vector<uint32_t> previousRight;
+        std::vector<uint32_t> bases;
+
+        for (const auto & tile : strip) {
+            const uint32_t base = parts.size();
+            bases.emplace_back(base);
+
+            parts.insert(parts.end(), tile.parts.begin(), tile.parts.end());
+            parent.resize(parts.size());
+            std::iota(parent.begin() + base, parent.end(), base);
+
+            // Objects crossing the edge to the tile on the left or the one above
+            for (uint32_t y = 0; y < previousRight.size(); ++y) {
+                if (previousRight[y] != Pixel::noIndex and tile.left[y] != Pixel::noIndex) {
+                    unite(parent, previousRight[y], base + tile.left[y]);
+                }
+            }
+
+            for (uint32_t x = 0; x < tile.width; ++x) {
+                if (above[tile.x + x] != Pixel::noIndex and tile.top[x] != Pixel::noIndex) {
+                    unite(parent, above[tile.x + x], base + tile.top[x]);
+                }
+            }
+
+            previousRight.clear();
+            for (const auto part : tile.right) {
+                previousRight.emplace_back(part == Pixel::noIndex ? part : base + part);
+            }
+        }
+
+        for (size_t t = 0; t < strip.size(); ++t) {
+            const auto & tile = strip[t];
+
+            for (uint32_t x = 0; x < tile.width; ++x) {
+                above[tile.x + x] = (tile.bottom[x] == Pixel::noIndex) ? Pixel::noIndex : bases[t] + tile.bottom[x];
+            }
+        }
+
+        compact();
+    }
+
+    void Stitcher::compact() {
+
+        // Every part is merged into the root of its object and pointed at it
+        for (uint32_t part = 0; part < parts.size(); ++part) {
+            const auto root = find(parent, part);
+
+            if (root != part) {
+                parts[root].merge(parts[part]);
+                parent[part] = root;
+            }
+        }
+
+        // Only objects reaching the bottom edge of the latest strip can grow any further
+        std::vector<bool> growing(parts.size(), false);
+
+        for (const auto part : above) {
+            if (part != Pixel::noIndex) {
+                growing[parent[part]] = true;
+            }
+        }
+
+        std::vector<Component> open;
+        std::vector<uint32_t> renumbered(parts.size(), Pixel::noIndex);
+
+        for (uint32_t part = 0; part < parts.size(); ++part) {
+            if (parent[part] != part) {
+                continue;
+            }
+
+            if (growing[part]) {
+                renumbered[part] = open.size();
+                open.emplace_back(parts[part]);
+            } else if (parts[part].acc.perimeter >= minPerimeter) {
+                // The same selection as filterBySize
+                finished.emplace_back(parts[part]);
+            }
+        }
+
+        for (auto & part : above) {
+            if (part != Pixel::noIndex) {
+                part = renumbered[parent[part]];
+            }
+        }
+
+        parts = std::move(open);
+        parent.resize(parts.size());
+        std::iota(parent.begin(), parent.end(), 0);
+    }
+
+    size_t Stitcher::pending() const {
+        return parts.size();
+    }
+
+    std::vector<Component> Stitcher::objects() {
+
+        // Nothing follows the last strip, so every object is complete
+        std::fill(above.begin(), above.end(), Pixel::noIndex);
+        compact();
+
+        std::vector<Component> objects = finished;
+
+        // The same order as filterBySize
+        std::sort(objects.begin(), objects.end(), [](const auto & c1, const auto & c2) {
+            return c1.acc.first < c2.acc.first;
+        });
+
+        return objects;
+    }
+
+    std::vector<Component> components(
+            const uint32_t width, const uint32_t height, const RowReader & rows,
+            const uint8_t threshold, const int minPerimeter,
+            const Options & options, ThreadPool & pool
+        ) {
+
+        if (not options.tileWidth or not options.tileHeight) {
+            throw std::runtime_error("Tiles must not be empty");
+        }
+
+        const uint32_t tilesPerStrip = (width + options.tileWidth - 1) / options.tileWidth;
+
+        Stitcher stitcher(width, minPerimeter);
+
+        for (uint32_t y0 = 0; y0 < height; y0 += options.tileHeight) {
+            const uint32_t stripHeight = std::min(options.tileHeight, height - y0);
+
+            std::vector<Tile> strip(tilesPerStrip);
+
+            pool.run(tilesPerStrip, [&](const size_t t) {
+                const uint32_t x0 = t * options.tileWidth;
+                strip[t] = label(x0, y0, std::min(options.tileWidth, width - x0), stripHeight, width, height, rows, threshold);
+            });
+
+            stitcher.add(strip);
+        }
+
+        return stitcher.objects();
+    }
+}
@@ -0,0 +1,103 @@
+#include "training.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace training {
+
+    static const double pi = std::acos(-1.0);
+
+    double learningRate(const Options & options, const size_t epoch) {
+
+        const double steps = std::max<size_t>(1, options.decaySteps);
+
+        switch (options.schedule) {
+            case Schedule::constant:
+                return options.learningRate;
+            case Schedule::step:
+                return options.learningRate * std::pow(options.decayFactor, std::floor(epoch / steps));
+            case Schedule::exponential:
+                return options.learningRate * std::pow(options.decayFactor, epoch / steps);
+            case Schedule::cosine: {
+                const double progress = std::min(1.0, epoch / (double)std::max<size_t>(1, options.maxEpochs));
+                return options.learningRate * 0.5 * (1 + std::cos(pi * progress));
+            }
+        }
+
+        return options.learningRate;
+    }
+
+    OptimizerState::OptimizerState(const Options & options, const size_t parameters) :
+        optimizer(options.optimizer),
+        momentum(options.momentum),
+        squaredDecay(options.squaredDecay),
+        epsilon(options.epsilon) {
+
+        if (optimizer != Optimizer::sgd and optimizer != Optimizer::rmsProp) {
+            velocity.resize(parameters, 0.0);
+        }
+        if (optimizer == Optimizer::rmsProp or optimizer == Optimizer::adam) {
+            squared.resize(parameters, 0.0);
+        }
+    }
+
+    void OptimizerState::beginStep() {
+        ++steps;
+    }
+
+    template <typename Scalar>
+    void OptimizerState::update(Scalar * params, const Scalar * gradient, const size_t offset, const size_t count, const double rate) {
+
+        switch (optimizer) {
+
+            case Optimizer::sgd:
+                for (size_t i = 0; i < count; ++i) {
+                    params[i] += rate * gradient[i];
+                }
+                break;
+
+            case Optimizer::momentum: {
+                double * v = velocity.data() + offset;
+
+                for (size_t i = 0; i < count; ++i) {
+                    v[i] = momentum * v[i] + rate * gradient[i];
+                    params[i] += v[i];
+                }
+                break;
+            }
+
+            case Optimizer::rmsProp: {
+                double * s = squared.data() + offset;
+
+                for (size_t i = 0; i < count; ++i) {
+                    s[i] = squaredDecay * s[i] + (1 - squaredDecay) * gradient[i] * gradient[i];
+                    params[i] += rate * gradient[i] / (std::sqrt(s[i]) + epsilon);
+                }
+                break;
+            }
+
+            case Optimizer::adam: {
+                double * m = velocity.data() + offset;
+                double * s = squared.data() + offset;
+
+                const double firstCorrection = 1 - std::pow(momentum, steps);
+                const double secondCorrection = 1 - std::pow(squaredDecay, steps);
+
+                for (size_t i = 0; i < count; ++i) {
+                    m[i] = momentum * m[i] + (1 - momentum) * gradient[i];
+                    s[i] = squaredDecay * s[i] + (1 - squaredDecay) * gradient[i] * gradient[i];
+
+                    const double mHat = m[i] / firstCorrection;
+                    const double sHat = s[i] / secondCorrection;
+                    params[i] += rate * mHat / (std::sqrt(sHat) + epsilon);
+                }
+                break;
+            }
+        }
+    }
+
+    template void OptimizerState::update<float>(float *, const float *, size_t, size_t, double);
+    template void OptimizerState::update<double>(double *, const double *, size_t, size_t, double);
+
+}
@@ -0,0 +1,130 @@
+#include "video_analyzer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+
+IncrementalLabeler::IncrementalLabeler(const tiling::Options & options) : options(options) {
+    if (not options.tileWidth or not options.tileHeight) {
+        throw std::runtime_error("Tiles must not be empty");
+    }
+}
+
+bool IncrementalLabeler::changed(const ImageView & frame, const tiling::Tile & tile) const {
+
+    // Pixels on the edges of a tile depend on the ring of pixels around it
+    const uint32_t left = tile.x ? tile.x - 1 : 0;
+    const uint32_t right = std::min(width, tile.x + tile.width + 1);
+    const uint32_t top = tile.y ? tile.y - 1 : 0;
+    const uint32_t bottom = std::min(height, tile.y + tile.height + 1);
+
+    const size_t bpp = bytesPerPixel(format);
+    const size_t rowBytes = size_t(width) * bpp;
+
+    for (uint32_t y = top; y < bottom; ++y) {
+        const uint8_t * current = frame.row(y) + left * bpp;
+        const uint8_t * before = previous.data() + y * rowBytes + left * bpp;
+
+        if (std::memcmp(current, before, (right - left) * bpp) != 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::vector<tiling::Component> IncrementalLabeler::update(const ImageView & frame, const uint8_t threshold, const int minPerimeter, ThreadPool & pool) {
+
+    const bool fresh = strips.empty() or frame.width() != width or frame.height() != height
+        or frame.format() != format or threshold != this->threshold;
+
+    if (fresh) {
+        width = frame.width();
+        height = frame.height();
+        format = frame.format();
+        this->threshold = threshold;
+
+        previous.assign(size_t(width) * height * bytesPerPixel(format), 0);
+        strips.clear();
+
+        for (uint32_t y0 = 0; y0 < height; y0 += options.tileHeight) {
+            std::vector<tiling::Tile> strip;
+
+            for (uint32_t x0 = 0; x0 < width; x0 += options.tileWidth) {
+                tiling::Tile tile;
+                tile.x = x0;
+                tile.y = y0;
+                tile.width = std::min(options.tileWidth, width - x0);
+                tile.height = std::min(options.tileHeight, height - y0);
+                strip.emplace_back(std::move(tile));
+            }
+
+            strips.emplace_back(std::move(strip));
+        }
+    }
+
+    std::vector<tiling::Tile *> tiles;
+    for (auto & strip : strips) {
+        for (auto & tile : strip) {
+            tiles.emplace_back(&tile);
+        }
+    }
+
+    std::vector<uint8_t> dirtyFlags(tiles.size(), fresh);
+
+    if (not fresh) {
+        pool.run(tiles.size(), [&](const size_t t) {
+            dirtyFlags[t] = changed(frame, *tiles[t]);
+        });
+    }
+
+    const auto rows = [&](const uint32_t y, std::vector<uint8_t> &) {
+        return frame.crop(0, y, width, 1);
+    };
+
+    const size_t bpp = bytesPerPixel(format);
+    const size_t rowBytes = size_t(width) * bpp;
+
+    // Every changed pixel lies within a dirty tile, so copying those keeps the previous frame exact
+    pool.run(tiles.size(), [&](const size_t t) {
+        if (not dirtyFlags[t]) {
+            return;
+        }
+
+        auto & tile = *tiles[t];
+        tile = tiling::label(tile.x, tile.y, tile.width, tile.height, width, height, rows, threshold);
+
+        for (uint32_t y = tile.y; y < tile.y + tile.height; ++y) {
+            std::memcpy(previous.data() + y * rowBytes + tile.x * bpp, frame.row(y) + tile.x * bpp, tile.width * bpp);
+        }
+    });
+
+    dirty = std::count(dirtyFlags.begin(), dirtyFlags.end(), 1);
+    total = tiles.size();
+
+    // Stitching touches only the parts and edges of the tiles, not their pixels
+    tiling::Stitcher stitcher(width, minPerimeter);
+
+    for (const auto & strip : strips) {
+        stitcher.add(strip);
+    }
+
+    return stitcher.objects();
+}
+
+size_t IncrementalLabeler::dirtyTiles() const {
+    return dirty;
+}
+
+size_t IncrementalLabeler::tiles() const {
+    return total;
+}
+
+void IncrementalLabeler::reset() {
+    width = 0;
+    height = 0;
+    previous.clear();
+    strips.clear();
+    dirty = 0;
+    total = 0;
+}
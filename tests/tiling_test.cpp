@@ -0,0 +1,147 @@
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "filters.hpp"
+#include "image_view.hpp"
+#include "indexer.hpp"
+#include "signals.hpp"
+#include "thread_pool.hpp"
+#include "thresholder.hpp"
+#include "tiling.hpp"
+
+
+/* Tiled labeling must find exactly the objects of thresholding, Indexer and filterBySize */
+/* over the whole image, whatever the size of the tiles.                                  */
+
+static constexpr uint8_t threshold = 35;
+static constexpr int minPerimeter = 15;
+
+static size_t failures = 0;
+
+static void check(const bool condition, const std::string & what) {
+    if (not condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+static bool sameSums(const signals::Accumulator & a1, const signals::Accumulator & a2) {
+    return a1.area == a2.area and a1.sumX == a2.sumX and a1.sumY == a2.sumY
+        and a1.sumXX == a2.sumXX and a1.sumYY == a2.sumYY and a1.sumXY == a2.sumXY
+        and a1.perimeter == a2.perimeter and a1.first == a2.first;
+}
+
+/* Rectangles, rings and diagonal strokes on a noisy background, so that objects of every */
+/* shape cross the edges of tiles and noise produces objects below the minimum perimeter  */
+static std::vector<uint8_t> generate(const uint32_t width, const uint32_t height, std::mt19937 & rng) {
+    std::vector<uint8_t> pixels(size_t(width) * height);
+
+    for (auto & px : pixels) {
+        px = (rng() % 50 == 0) ? 200 : rng() % 30;
+    }
+
+    const uint32_t shapes = 1 + width * height / 400;
+
+    for (uint32_t s = 0; s < shapes; ++s) {
+        const uint32_t x0 = rng() % width;
+        const uint32_t y0 = rng() % height;
+        const uint32_t w = 1 + rng() % std::max(1u, width / 3);
+        const uint32_t h = 1 + rng() % std::max(1u, height / 3);
+        const uint32_t kind = rng() % 3;
+
+        for (uint32_t y = y0; y < std::min(height, y0 + h); ++y) {
+            for (uint32_t x = x0; x < std::min(width, x0 + w); ++x) {
+                const bool edge = x == x0 or y == y0 or x + 1 == x0 + w or y + 1 == y0 + h;
+                const bool stroke = (x - x0) % 7 == (y - y0) % 7;
+
+                if (kind == 0 or (kind == 1 and edge) or (kind == 2 and stroke)) {
+                    pixels[size_t(y) * width + x] = 100 + rng() % 156;
+                }
+            }
+        }
+    }
+
+    return pixels;
+}
+
+static std::vector<signals::Accumulator> reference(const ImageView & view, ThreadPool & pool) {
+    Thresholder<ConstantThreshold<threshold>> thresholder;
+    Indexer indexer;
+
+    const auto filtered = filterBySize(indexer.assignIndices(thresholder.findThresholds(view, pool), pool), minPerimeter, pool);
+
+    std::vector<signals::Accumulator> objects;
+    for (const auto & acc : signals::accumulate(filtered, pool)) {
+        if (acc.area) {
+            objects.emplace_back(acc);
+        }
+    }
+
+    return objects;
+}
+
+int main() {
+    ThreadPool pool(4);
+    std::mt19937 rng(2024);
+
+    const std::vector<std::pair<uint32_t, uint32_t>> sizes = {
+        { 1, 1 }, { 1, 57 }, { 61, 1 }, { 17, 13 }, { 64, 64 }, { 200, 120 }, { 97, 311 }, { 512, 384 }
+    };
+    const std::vector<tiling::Options> tilings = {
+        { 1, 1 }, { 3, 7 }, { 16, 16 }, { 64, 5 }, { 5, 64 }, { 100, 100 }, { 1024, 1024 }
+    };
+
+    for (const auto & [width, height] : sizes) {
+        const auto pixels = generate(width, height, rng);
+        const ImageView view(pixels.data(), width, height, 0, PixelFormat::gray8);
+
+        const auto rows = [&](const uint32_t y, std::vector<uint8_t> &) {
+            return view.crop(0, y, width, 1);
+        };
+
+        const auto expected = reference(view, pool);
+        const std::string image = std::to_string(width) + "x" + std::to_string(height);
+
+        for (const auto & options : tilings) {
+            const auto objects = tiling::components(width, height, rows, threshold, minPerimeter, options, pool);
+            const std::string what = image + " in tiles of " + std::to_string(options.tileWidth) + "x" + std::to_string(options.tileHeight);
+
+            check(objects.size() == expected.size(), what + " finds " + std::to_string(objects.size()) + " objects instead of " + std::to_string(expected.size()));
+
+            for (size_t i = 0; i < std::min(objects.size(), expected.size()); ++i) {
+                check(sameSums(objects[i].acc, expected[i]), what + " differs in object " + std::to_string(i));
+            }
+        }
+
+        // The table of the stitcher holds at most the objects crossing the bottom edge of a strip
+        const tiling::Options options { 16, 16 };
+        tiling::Stitcher stitcher(width, minPerimeter);
+
+        for (uint32_t y0 = 0; y0 < height; y0 += options.tileHeight) {
+            std::vector<tiling::Tile> strip;
+
+            for (uint32_t x0 = 0; x0 < width; x0 += options.tileWidth) {
+                strip.emplace_back(tiling::label(
+                    x0, y0, std::min(options.tileWidth, width - x0), std::min(options.tileHeight, height - y0),
+                    width, height, rows, threshold
+                ));
+            }
+
+            stitcher.add(strip);
+            check(stitcher.pending() <= (width + 1) / 2, image + " keeps " + std::to_string(stitcher.pending()) + " parts");
+        }
+
+        check(stitcher.objects().size() == expected.size(), image + " stitched strip by strip");
+    }
+
+    if (failures) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Tiled and whole image labeling agree" << std::endl;
+    return 0;
+}